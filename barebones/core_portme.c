@@ -120,7 +120,9 @@ time_in_secs(CORE_TICKS ticks)
     return retval;
 }
 
-ee_u32 default_num_contexts = 1;
+ee_u32 default_num_contexts  = 1;
+ee_u32 default_num_trials    = 1;
+ee_u32 default_output_format = 0;
 
 /* Function : portable_init
         Target specific initialization code
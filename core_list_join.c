@@ -46,7 +46,45 @@ indicates if the lower 7 bits are to be used as is or calculated. o Bits 0-2
 indicate type of operation to perform to get a 7b value. o Bits 3-6 provide
 input for the operation.
 
+        With <LIST_WIDE> both are 32b. The data keeps the layout above in its
+lower 16b, and a payload derived from the seed in its upper 16b.
+
+*/
+
+/* Links:
+        How a cell reaches the next cell and its data, see <LIST_LINKS>.
+   Offsets count <LIST_LINK_UNIT> bytes from the cell itself, so they need
+   no base and every context keeps its own list. An offset of 0 stands for
+   no next cell, as a cell never follows itself.
 */
+#if (LIST_LINKS == LIST_POINTERS)
+#define LIST_NEXT(cell)        ((cell)->next)
+#define LIST_INFO(cell)        ((cell)->info)
+#define LIST_SET_NEXT(cell, p) ((cell)->next = (p))
+#define LIST_SET_INFO(cell, p) ((cell)->info = (p))
+#else
+#define LIST_OFFSET(cell, p) \
+    ((list_link)(((ee_u8 *)(p) - (ee_u8 *)(cell)) / LIST_LINK_UNIT))
+#define LIST_AT(cell, link) ((ee_u8 *)(cell) + (ee_s32)(link)*LIST_LINK_UNIT)
+#define LIST_NEXT(cell) \
+    ((cell)->next ? (list_head *)LIST_AT(cell, (cell)->next) : NULL)
+#define LIST_INFO(cell) ((list_data *)LIST_AT(cell, (cell)->info))
+#define LIST_SET_NEXT(cell, p) \
+    ((cell)->next = (p) ? LIST_OFFSET(cell, p) : 0)
+#define LIST_SET_INFO(cell, p) ((cell)->info = LIST_OFFSET(cell, p))
+#endif
+
+/* CRC of the data as the list is walked from <finder>: the standard list
+ * takes the data of its head for every item walked, the wide one that of
+ * each item walked. */
+#if LIST_WIDE
+#define LIST_CRC(list, finder, crc) \
+    crcu32((ee_u32)LIST_INFO(finder)->data16, crc)
+#define LIST_IDX_LAST 0x7fffffff
+#else
+#define LIST_CRC(list, finder, crc) crc16(LIST_INFO(list)->data16, crc)
+#define LIST_IDX_LAST 0x7fff
+#endif
 
 /* local functions */
 
@@ -67,15 +105,19 @@ list_head *core_list_mergesort(list_head *   list,
                                core_results *res);
 
 ee_s16
-calc_func(ee_s16 *pdata, core_results *res)
+calc_func(list_value *pdata, core_results *res)
 {
-    ee_s16 data = *pdata;
+    ee_s16 data = (ee_s16)*pdata;
     ee_s16 retval;
     ee_u8  optype
         = (data >> 7)
           & 1;  /* bit 7 indicates if the function result has been cached */
+    PROFILE_VAR(begin);
     if (optype) /* if cached, use cache */
+    {
+        PROFILE_COUNT(&res->profile, KERNEL_CALC_HIT);
         return (data & 0x007f);
+    }
     else
     {                             /* otherwise calculate and cache the result */
         ee_s16 flag = data & 0x7; /* bits 0-2 is type of function to perform */
@@ -83,6 +125,7 @@ calc_func(ee_s16 *pdata, core_results *res)
             = ((data >> 3)
                & 0xf);       /* bits 3-6 is specific data for the operation */
         dtype |= dtype << 4; /* replicate the lower 4 bits to get an 8b value */
+        PROFILE_BEGIN(begin);
         switch (flag)
         {
             case 0:
@@ -93,12 +136,14 @@ calc_func(ee_s16 *pdata, core_results *res)
                                           res->seed1,
                                           res->seed2,
                                           dtype,
-                                          res->crc);
+                                          res->crc PROFILE_ARG(&res->profile));
                 if (res->crcstate == 0)
                     res->crcstate = retval;
                 break;
             case 1:
-                retval = core_bench_matrix(&(res->mat), dtype, res->crc);
+                retval = core_bench_matrix(&(res->mat),
+                                           dtype,
+                                           res->crc PROFILE_ARG(&res->profile));
                 if (res->crcmatrix == 0)
                     res->crcmatrix = retval;
                 break;
@@ -108,7 +153,10 @@ calc_func(ee_s16 *pdata, core_results *res)
         }
         res->crc = crcu16(retval, res->crc);
         retval &= 0x007f;
-        *pdata = (data & 0xff00) | 0x0080 | retval; /* cache the result */
+        /* cache the result, keeping any payload above the 16b */
+        *pdata = (*pdata & ~(list_value)0xffff)
+                 | (ee_u16)((data & 0xff00) | 0x0080 | retval);
+        PROFILE_END(&res->profile, KERNEL_CALC_MISS, begin);
         return retval;
     }
 }
@@ -135,8 +183,10 @@ cmp_idx(list_data *a, list_data *b, core_results *res)
 {
     if (res == NULL)
     {
-        a->data16 = (a->data16 & 0xff00) | (0x00ff & (a->data16 >> 8));
-        b->data16 = (b->data16 & 0xff00) | (0x00ff & (b->data16 >> 8));
+        a->data16 = (a->data16 & ~(list_value)0xff)
+                    | (0x00ff & (a->data16 >> 8));
+        b->data16 = (b->data16 & ~(list_value)0xff)
+                    | (0x00ff & (b->data16 >> 8));
     }
     return a->idx - b->idx;
 }
@@ -166,6 +216,7 @@ core_bench_list(core_results *res, ee_s16 finder_idx)
     list_head *finder, *remover;
     list_data  info = {0};
     ee_s16     i;
+    PROFILE_VAR(begin);
 
     info.idx = finder_idx;
     /* find <find_num> values in the list, and change the list each time
@@ -173,25 +224,29 @@ core_bench_list(core_results *res, ee_s16 finder_idx)
     for (i = 0; i < find_num; i++)
     {
         info.data16 = (i & 0xff);
-        this_find   = core_list_find(list, &info);
-        list        = core_list_reverse(list);
+        PROFILE_BEGIN(begin);
+        this_find = core_list_find(list, &info);
+        PROFILE_END(&res->profile, KERNEL_LIST_FIND, begin);
+        PROFILE_BEGIN(begin);
+        list = core_list_reverse(list);
+        PROFILE_END(&res->profile, KERNEL_LIST_REVERSE, begin);
         if (this_find == NULL)
         {
             missed++;
-            retval += (list->next->info->data16 >> 8) & 1;
+            retval += (LIST_INFO(LIST_NEXT(list))->data16 >> 8) & 1;
         }
         else
         {
             found++;
-            if (this_find->info->data16 & 0x1) /* use found value */
-                retval += (this_find->info->data16 >> 9) & 1;
+            if (LIST_INFO(this_find)->data16 & 0x1) /* use found value */
+                retval += (LIST_INFO(this_find)->data16 >> 9) & 1;
             /* and cache next item at the head of the list (if any) */
-            if (this_find->next != NULL)
+            if (LIST_NEXT(this_find) != NULL)
             {
-                finder          = this_find->next;
-                this_find->next = finder->next;
-                finder->next    = list->next;
-                list->next      = finder;
+                finder = LIST_NEXT(this_find);
+                LIST_SET_NEXT(this_find, LIST_NEXT(finder));
+                LIST_SET_NEXT(finder, LIST_NEXT(list));
+                LIST_SET_NEXT(list, finder);
             }
         }
         if (info.idx >= 0)
@@ -203,30 +258,38 @@ core_bench_list(core_results *res, ee_s16 finder_idx)
     retval += found * 4 - missed;
     /* sort the list by data content and remove one item*/
     if (finder_idx > 0)
+    {
+        PROFILE_BEGIN(begin);
         list = core_list_mergesort(list, cmp_complex, res);
-    remover = core_list_remove(list->next);
+        PROFILE_END(&res->profile, KERNEL_LIST_MERGESORT, begin);
+    }
+    remover = core_list_remove(LIST_NEXT(list));
     /* CRC data content of list from location of index N forward, and then undo
      * remove */
+    PROFILE_BEGIN(begin);
     finder = core_list_find(list, &info);
+    PROFILE_END(&res->profile, KERNEL_LIST_FIND, begin);
     if (!finder)
-        finder = list->next;
+        finder = LIST_NEXT(list);
     while (finder)
     {
-        retval = crc16(list->info->data16, retval);
-        finder = finder->next;
+        retval = LIST_CRC(list, finder, retval);
+        finder = LIST_NEXT(finder);
     }
 #if CORE_DEBUG
     ee_printf("List sort 1: %04x\n", retval);
 #endif
-    remover = core_list_undo_remove(remover, list->next);
+    remover = core_list_undo_remove(remover, LIST_NEXT(list));
     /* sort the list by index, in effect returning the list to original state */
+    PROFILE_BEGIN(begin);
     list = core_list_mergesort(list, cmp_idx, NULL);
+    PROFILE_END(&res->profile, KERNEL_LIST_MERGESORT, begin);
     /* CRC data content of list */
-    finder = list->next;
+    finder = LIST_NEXT(list);
     while (finder)
     {
-        retval = crc16(list->info->data16, retval);
-        finder = finder->next;
+        retval = LIST_CRC(list, finder, retval);
+        finder = LIST_NEXT(finder);
     }
 #if CORE_DEBUG
     ee_printf("List sort 2: %04x\n", retval);
@@ -251,10 +314,7 @@ list_head *
 core_list_init(ee_u32 blksize, list_head *memblock, ee_s16 seed)
 {
     /* calculated pointers for the list */
-    ee_u32 per_item = 16 + sizeof(struct list_data_s);
-    ee_u32 size     = (blksize / per_item)
-                  - 2; /* to accommodate systems with 64b pointers, and make sure
-                          same code is executed, set max list elements */
+    ee_u32     size          = LIST_ITEMS(blksize);
     list_head *memblock_end  = memblock + size;
     list_data *datablock     = (list_data *)(memblock_end);
     list_data *datablock_end = datablock + size;
@@ -264,13 +324,13 @@ core_list_init(ee_u32 blksize, list_head *memblock, ee_s16 seed)
     list_data  info;
 
     /* create a fake items for the list head and tail */
-    list->next         = NULL;
-    list->info         = datablock;
-    list->info->idx    = 0x0000;
-    list->info->data16 = (ee_s16)0x8080;
+    LIST_SET_NEXT(list, NULL);
+    LIST_SET_INFO(list, datablock);
+    LIST_INFO(list)->idx    = 0x0000;
+    LIST_INFO(list)->data16 = (ee_s16)0x8080;
     memblock++;
     datablock++;
-    info.idx    = 0x7fff;
+    info.idx    = LIST_IDX_LAST;
     info.data16 = (ee_s16)0xffff;
     core_list_insert_new(
         list, &info, &memblock, &datablock, memblock_end, datablock_end);
@@ -283,25 +343,35 @@ core_list_init(ee_u32 blksize, list_head *memblock, ee_s16 seed)
             = (datpat << 3) | (i & 0x7); /* alternate between algorithms */
         info.data16 = (dat << 8) | dat;  /* fill the data with actual data and
                                             upper bits with rebuild value */
+#if LIST_WIDE
+        /* payload */
+        info.data16 |= (list_value)((ee_u32)(ee_u16)(seed + i) << 16);
+#endif
         core_list_insert_new(
             list, &info, &memblock, &datablock, memblock_end, datablock_end);
     }
     /* and now index the list so we know initial seed order of the list */
-    finder = list->next;
+    finder = LIST_NEXT(list);
     i      = 1;
-    while (finder->next != NULL)
+    while (LIST_NEXT(finder) != NULL)
     {
         if (i < size / 5) /* first 20% of the list in order */
-            finder->info->idx = i++;
+            LIST_INFO(finder)->idx = i++;
         else
         {
+#if LIST_WIDE
+            /* the same pattern over 24b, with the seed in both halves */
+            ee_u32 pat = (i++ ^ ((ee_u32)(ee_u16)seed * 0x10001)) & 0xffffff;
+            LIST_INFO(finder)->idx = 0x3fffffff & (((i & 0x07) << 24) | pat);
+#else
             ee_u16 pat = (ee_u16)(i++ ^ seed); /* get a pseudo random number */
-            finder->info->idx = 0x3fff
+            LIST_INFO(finder)->idx = 0x3fff
                                 & (((i & 0x07) << 8)
                                    | pat); /* make sure the mixed items end up
                                               after the ones in sequence */
+#endif
         }
-        finder = finder->next;
+        finder = LIST_NEXT(finder);
     }
     list = core_list_mergesort(list, cmp_idx, NULL);
 #if CORE_DEBUG
@@ -309,15 +379,85 @@ core_list_init(ee_u32 blksize, list_head *memblock, ee_s16 seed)
     finder = list;
     while (finder)
     {
-        ee_printf(
-            "[%04x,%04x]", finder->info->idx, (ee_u16)finder->info->data16);
-        finder = finder->next;
+        ee_printf("[%04x,%04x]",
+                  LIST_INFO(finder)->idx,
+                  (ee_u16)LIST_INFO(finder)->data16);
+        finder = LIST_NEXT(finder);
     }
     ee_printf("\n");
 #endif
     return list;
 }
 
+/* Bytes a scattered cell or data item starts at a multiple of, and the
+ * address of slot <slot> of region <region> */
+#define LIST_SCATTER_SLOT 16
+#define LIST_SCATTER_AT(block, region, slots, slot) \
+    ((ee_u8 *)(block) + ((region) * (slots) + (slot)) * LIST_SCATTER_SLOT)
+
+/* Function: list_scatter_next
+        The region after <x> in the order regions are visited in: a full
+   period LCG modulo <mask> + 1, a power of two, with <c> odd, that skips the
+   values past the last of <regions>.
+*/
+static ee_u32
+list_scatter_next(ee_u32 x, ee_u32 mask, ee_u32 c, ee_u32 regions)
+{
+    do
+        x = (1664525 * x + c) & mask;
+    while (x >= regions);
+    return x;
+}
+/* Function: core_list_scatter
+        Move every cell of the list and its data to a slot of its own within
+   <footprint> bytes at <block>.
+
+        Operation:
+        The footprint is divided into one region per cell and per data item,
+   visited in an order drawn from <seed>, see <list_scatter_next>. Each cell
+   or data item lands on a slot within its region that depends on its
+   position in the list, so neither the order of the cells nor the distance
+   between neighbours follows a pattern a prefetcher could learn. Only the
+   addresses change: the list, and so its CRCs, stay the same.
+
+        Returns:
+        The head of the moved list, or NULL if the footprint has less than one
+   <LIST_SCATTER_SLOT> per cell and data item.
+*/
+list_head *
+core_list_scatter(list_head *list, void *block, ee_u32 footprint, ee_s16 seed)
+{
+    ee_u32     n = 0, regions, slots, mask = 1, x = 0, k = 0;
+    ee_u32     c = ((ee_u32)(ee_u16)seed << 1) | 1;
+    list_head *cell, *moved, *head = NULL, *tail = NULL;
+    list_data *data;
+    for (cell = list; cell; cell = LIST_NEXT(cell))
+        n++;
+    regions = 2 * n;
+    slots   = footprint / regions / LIST_SCATTER_SLOT;
+    if (slots == 0)
+        return NULL;
+    while (mask + 1 < regions)
+        mask = (mask << 1) | 1;
+    for (cell = list; cell; cell = LIST_NEXT(cell), k++)
+    {
+        ee_u32 slot = ((k * 2654435761u) >> 8) % slots;
+        x           = list_scatter_next(x, mask, c, regions);
+        moved       = (list_head *)LIST_SCATTER_AT(block, x, slots, slot);
+        x           = list_scatter_next(x, mask, c, regions);
+        data        = (list_data *)LIST_SCATTER_AT(block, x, slots, slot);
+        *data       = *LIST_INFO(cell);
+        LIST_SET_INFO(moved, data);
+        if (tail)
+            LIST_SET_NEXT(tail, moved);
+        else
+            head = moved;
+        tail = moved;
+    }
+    LIST_SET_NEXT(tail, NULL);
+    return head;
+}
+
 /* Function: core_list_insert
         Insert an item to the list
 
@@ -349,12 +489,12 @@ core_list_insert_new(list_head * insert_point,
 
     newitem = *memblock;
     (*memblock)++;
-    newitem->next      = insert_point->next;
-    insert_point->next = newitem;
+    LIST_SET_NEXT(newitem, LIST_NEXT(insert_point));
+    LIST_SET_NEXT(insert_point, newitem);
 
-    newitem->info = *datablock;
+    LIST_SET_INFO(newitem, *datablock);
     (*datablock)++;
-    copy_info(newitem->info, info);
+    copy_info(LIST_INFO(newitem), info);
 
     return newitem;
 }
@@ -377,14 +517,14 @@ list_head *
 core_list_remove(list_head *item)
 {
     list_data *tmp;
-    list_head *ret = item->next;
+    list_head *ret = LIST_NEXT(item);
     /* swap data pointers */
-    tmp        = item->info;
-    item->info = ret->info;
-    ret->info  = tmp;
+    tmp = LIST_INFO(item);
+    LIST_SET_INFO(item, LIST_INFO(ret));
+    LIST_SET_INFO(ret, tmp);
     /* and eliminate item */
-    item->next = item->next->next;
-    ret->next  = NULL;
+    LIST_SET_NEXT(item, LIST_NEXT(LIST_NEXT(item)));
+    LIST_SET_NEXT(ret, NULL);
     return ret;
 }
 
@@ -409,12 +549,12 @@ core_list_undo_remove(list_head *item_removed, list_head *item_modified)
 {
     list_data *tmp;
     /* swap data pointers */
-    tmp                 = item_removed->info;
-    item_removed->info  = item_modified->info;
-    item_modified->info = tmp;
+    tmp = LIST_INFO(item_removed);
+    LIST_SET_INFO(item_removed, LIST_INFO(item_modified));
+    LIST_SET_INFO(item_modified, tmp);
     /* and insert item */
-    item_removed->next  = item_modified->next;
-    item_modified->next = item_removed;
+    LIST_SET_NEXT(item_removed, LIST_NEXT(item_modified));
+    LIST_SET_NEXT(item_modified, item_removed);
     return item_removed;
 }
 
@@ -436,14 +576,14 @@ core_list_find(list_head *list, list_data *info)
 {
     if (info->idx >= 0)
     {
-        while (list && (list->info->idx != info->idx))
-            list = list->next;
+        while (list && (LIST_INFO(list)->idx != info->idx))
+            list = LIST_NEXT(list);
         return list;
     }
     else
     {
-        while (list && ((list->info->data16 & 0xff) != info->data16))
-            list = list->next;
+        while (list && ((LIST_INFO(list)->data16 & 0xff) != info->data16))
+            list = LIST_NEXT(list);
         return list;
     }
 }
@@ -467,8 +607,8 @@ core_list_reverse(list_head *list)
     list_head *next = NULL, *tmp;
     while (list)
     {
-        tmp        = list->next;
-        list->next = next;
+        tmp = LIST_NEXT(list);
+        LIST_SET_NEXT(list, next);
         next       = list;
         list       = tmp;
     }
@@ -521,7 +661,7 @@ core_list_mergesort(list_head *list, list_cmp cmp, core_results *res)
             for (i = 0; i < insize; i++)
             {
                 psize++;
-                q = q->next;
+                q = LIST_NEXT(q);
                 if (!q)
                     break;
             }
@@ -538,36 +678,36 @@ core_list_mergesort(list_head *list, list_cmp cmp, core_results *res)
                 {
                     /* p is empty; e must come from q. */
                     e = q;
-                    q = q->next;
+                    q = LIST_NEXT(q);
                     qsize--;
                 }
                 else if (qsize == 0 || !q)
                 {
                     /* q is empty; e must come from p. */
                     e = p;
-                    p = p->next;
+                    p = LIST_NEXT(p);
                     psize--;
                 }
-                else if (cmp(p->info, q->info, res) <= 0)
+                else if (cmp(LIST_INFO(p), LIST_INFO(q), res) <= 0)
                 {
                     /* First element of p is lower (or same); e must come from
                      * p. */
                     e = p;
-                    p = p->next;
+                    p = LIST_NEXT(p);
                     psize--;
                 }
                 else
                 {
                     /* First element of q is lower; e must come from q. */
                     e = q;
-                    q = q->next;
+                    q = LIST_NEXT(q);
                     qsize--;
                 }
 
                 /* add the next element to the merged list */
                 if (tail)
                 {
-                    tail->next = e;
+                    LIST_SET_NEXT(tail, e);
                 }
                 else
                 {
@@ -580,7 +720,7 @@ core_list_mergesort(list_head *list, list_cmp cmp, core_results *res)
             p = q;
         }
 
-        tail->next = NULL;
+        LIST_SET_NEXT(tail, NULL);
 
         /* If we have done only one merge, we're finished. */
         if (nmerges <= 1) /* allow for nmerges==0, the empty list case */
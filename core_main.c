@@ -33,6 +33,26 @@ Original Author: Shay Gal-on
         Returns:
         NULL.
 */
+#if LIST_WIDE
+/* The 32b list, see LIST_WIDE, holds fewer items in the same size and
+ * feeds the matrix and state kernels a different CRC, so all three differ
+ * from the standard ones. */
+static ee_u16 list_known_crc[]   = { (ee_u16)0x847b,
+                                   (ee_u16)0x5f12,
+                                   (ee_u16)0x470e,
+                                   (ee_u16)0xf1ca,
+                                   (ee_u16)0x0b1f };
+static ee_u16 matrix_known_crc[] = { (ee_u16)0x7572,
+                                     (ee_u16)0xd576,
+                                     (ee_u16)0x3d82,
+                                     (ee_u16)0x1bc8,
+                                     (ee_u16)0x08aa };
+static ee_u16 state_known_crc[]  = { (ee_u16)0x02cf,
+                                    (ee_u16)0x5325,
+                                    (ee_u16)0xb37b,
+                                    (ee_u16)0x4f04,
+                                    (ee_u16)0xe1dd };
+#else
 static ee_u16 list_known_crc[]   = { (ee_u16)0xd4b0,
                                    (ee_u16)0x3340,
                                    (ee_u16)0x6a79,
@@ -48,43 +68,1888 @@ static ee_u16 state_known_crc[]  = { (ee_u16)0x5e47,
                                     (ee_u16)0xe5a4,
                                     (ee_u16)0x8e3a,
                                     (ee_u16)0x8d84 };
+#endif
+static char *known_run_name[]    = { "6k performance",
+                                   "6k validation",
+                                   "Profile generation",
+                                   "2K performance",
+                                   "2K validation" };
 void *
 iterate(void *pres)
 {
-    ee_u32        i;
-    ee_u16        crc;
-    core_results *res        = (core_results *)pres;
-    ee_u32        iterations = res->iterations;
-    res->crc                 = 0;
-    res->crclist             = 0;
-    res->crcmatrix           = 0;
-    res->crcstate            = 0;
+    core_results *res = (core_results *)pres;
+    iterate_batch(res, 0, res->iterations);
+    return NULL;
+}
+/* Function: iterate_batch
+        Run <count> iterations of the benchmark, starting at iteration
+   <first>.
+
+        Batches of one context must run in order. Each batch continues the
+   CRC of the previous one, so running iterations 0..N-1 in several batches
+   gives the same results as <iterate>. Outputs are reset when <first> is 0.
+*/
+void
+iterate_batch(core_results *res, ee_u32 first, ee_u32 count)
+{
+    ee_u32 i;
+    ee_u16 crc;
+    ee_u32 last = first + count;
+#if LATENCY_HISTOGRAM
+    ee_u64 begin_ns;
+#endif
+    if (first == 0)
+    {
+        res->crc       = 0;
+        res->crclist   = 0;
+        res->crcmatrix = 0;
+        res->crcstate  = 0;
+#if LATENCY_HISTOGRAM
+        latency_reset(&res->latency);
+#endif
+#if KERNEL_PROFILE
+        for (i = 0; i < NUM_KERNELS; i++)
+            res->profile.calls[i] = res->profile.ns[i] = 0;
+#endif
+    }
+
+    for (i = first; i < last; i++)
+    {
+#if LATENCY_HISTOGRAM
+        begin_ns = portable_clock_ns();
+#endif
+        crc      = core_bench_list(res, 1);
+        res->crc = crcu16(crc, res->crc);
+        crc      = core_bench_list(res, -1);
+        res->crc = crcu16(crc, res->crc);
+        if (i == 0)
+            res->crclist = res->crc;
+#if LATENCY_HISTOGRAM
+        latency_record(&res->latency, portable_clock_ns() - begin_ns);
+#endif
+    }
+}
+
+#if (SEED_METHOD == SEED_ARG)
+ee_s32 get_seed_args(int i, int argc, char *argv[]);
+#define get_seed(x)    (ee_s16) get_seed_args(x, argc, argv)
+#define get_seed_32(x) get_seed_args(x, argc, argv)
+#else /* via function or volatile */
+ee_s32 get_seed_32(int i);
+#define get_seed(x) (ee_s16) get_seed_32(x)
+#endif
+
+#if (MEM_METHOD == MEM_STATIC)
+ee_u8 static_memblk[TOTAL_DATA_SIZE];
+#endif
+char *mem_name[3] = { "Static", "Heap", "Stack" };
+
+#if (MULTITHREAD > 1)
+/* Function: report_contexts
+        Report the time each context spent in the benchmark and its own
+   throughput, next to the aggregate numbers.
+
+        Ticks are relative to <start_time>. Start skew is the time between
+   the first and the last context to start, straggler spread the time between
+   the first and the last context to finish.
+*/
+static void
+report_contexts(core_results *results, ee_u32 num_contexts)
+{
+    ee_u32     i;
+    CORE_TICKS first_start = results[0].start_ticks;
+    CORE_TICKS last_start  = results[0].start_ticks;
+    CORE_TICKS first_stop  = results[0].stop_ticks;
+    CORE_TICKS last_stop   = results[0].stop_ticks;
+
+    for (i = 0; i < num_contexts; i++)
+    {
+        CORE_TICKS ticks = results[i].stop_ticks - results[i].start_ticks;
+        ee_printf("[%d]ticks         : %ld - %ld\n",
+                  i,
+                  (long)results[i].start_ticks,
+                  (long)results[i].stop_ticks);
+        ee_printf("[%d]iterations    : %lu\n",
+                  i,
+                  (long unsigned)results[i].iterations);
+        if (results[i].cpu >= 0)
+            ee_printf("[%d]cpu           : %d\n", i, results[i].cpu);
+        if (results[i].mem_node >= 0)
+            ee_printf("[%d]memory node   : %d\n", i, results[i].mem_node);
+#if HAS_FLOAT
+        if (time_in_secs(ticks) > 0)
+            ee_printf("[%d]Iterations/Sec: %f\n",
+                      i,
+                      results[i].iterations / time_in_secs(ticks));
+#else
+        if (time_in_secs(ticks) > 0)
+            ee_printf("[%d]Iterations/Sec: %d\n",
+                      i,
+                      results[i].iterations / time_in_secs(ticks));
+#endif
+        if (results[i].start_ticks < first_start)
+            first_start = results[i].start_ticks;
+        if (results[i].start_ticks > last_start)
+            last_start = results[i].start_ticks;
+        if (results[i].stop_ticks < first_stop)
+            first_stop = results[i].stop_ticks;
+        if (results[i].stop_ticks > last_stop)
+            last_stop = results[i].stop_ticks;
+    }
+    ee_printf("Start skew       : %ld\n", (long)(last_start - first_start));
+    ee_printf("Straggler spread : %ld\n", (long)(last_stop - first_stop));
+}
+#endif
+/* Trials:
+        Time and iterations of each repetition of the timed run. <order> lists
+   the trials by throughput, slowest first, and the trials from <first_kept>
+   to <last_kept> in that order are the ones left after outlier rejection.
+*/
+typedef struct CORE_TRIALS_S
+{
+    CORE_TICKS ticks[MAX_TRIALS];
+    ee_u64     iterations[MAX_TRIALS];
+    ee_u32     order[MAX_TRIALS];
+    ee_u32     num;
+    ee_u32     first_kept;
+    ee_u32     last_kept;
+} core_trials;
+
+static core_trials trials;
+
+/* Function: trials_sort
+        Order the trials by throughput. Rates are compared as cross products
+   so that this works without floating point.
+*/
+static void
+trials_sort(core_trials *t)
+{
+    ee_u32 i, j;
+    for (i = 0; i < t->num; i++)
+    {
+        ee_u32 cur = t->order[i] = i;
+        for (j = i; j > 0; j--)
+        {
+            ee_u32 prev = t->order[j - 1];
+            if (t->iterations[prev] * t->ticks[cur]
+                <= t->iterations[cur] * t->ticks[prev])
+                break;
+            t->order[j] = prev;
+        }
+        t->order[j] = cur;
+    }
+    t->first_kept = 0;
+    t->last_kept  = t->num - 1;
+}
+/* Function: trials_median
+        The trial with the median throughput of the kept trials, the slower
+   of the two middle ones for an even count so that it is an actual run. The
+   reported Iterations/Sec and the CoreMark score are those of this trial.
+*/
+static ee_u32
+trials_median(core_trials *t)
+{
+    return t->order[t->first_kept + (t->last_kept - t->first_kept) / 2];
+}
+static ee_u8
+trial_rejected(core_trials *t, ee_u32 trial)
+{
+    ee_u32 k;
+    for (k = t->first_kept; k <= t->last_kept; k++)
+        if (t->order[k] == trial)
+            return 0;
+    return 1;
+}
+#if HAS_FLOAT
+static secs_ret
+trial_rate(core_trials *t, ee_u32 trial)
+{
+    if (time_in_secs(t->ticks[trial]) > 0)
+        return t->iterations[trial] / time_in_secs(t->ticks[trial]);
+    return 0;
+}
+/* Function: trials_reject
+        Reject outliers with Tukey's fences: with at least 4 trials, a trial
+   whose throughput is more than 1.5 interquartile ranges below the first or
+   above the third quartile is not kept. Quartiles are taken at the nearest
+   rank.
+*/
+static void
+trials_reject(core_trials *t)
+{
+    secs_ret q1, q3, fence;
+    if (t->num < 4)
+        return;
+    q1    = trial_rate(t, t->order[(t->num - 1) / 4]);
+    q3    = trial_rate(t, t->order[(3 * (t->num - 1)) / 4]);
+    fence = (q3 - q1) * 3 / 2;
+    while (trial_rate(t, t->order[t->first_kept]) < q1 - fence)
+        t->first_kept++;
+    while (trial_rate(t, t->order[t->last_kept]) > q3 + fence)
+        t->last_kept--;
+}
+/* two sided 95% quantiles of Student's t for 1 to 30 degrees of freedom,
+ * the normal quantile is used beyond that */
+static secs_ret student_t95[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447,
+                                  2.365,  2.306, 2.262, 2.228, 2.201, 2.179,
+                                  2.160,  2.145, 2.131, 2.120, 2.110, 2.101,
+                                  2.093,  2.086, 2.080, 2.074, 2.069, 2.064,
+                                  2.060,  2.056, 2.052, 2.048, 2.045, 2.042 };
+static secs_ret
+stat_sqrt(secs_ret x)
+{
+    secs_ret r = x;
+    ee_u32   i;
+    if (x <= 0)
+        return 0;
+    for (i = 0; i < 64; i++)
+        r = (r + x / r) / 2;
+    return r;
+}
+/* Function: trials_stats
+        Mean and standard deviation of the throughput of the kept trials, and
+   the half width of the 95% confidence interval of their mean.
+*/
+static void
+trials_stats(core_trials *t, secs_ret *mean, secs_ret *sd, secs_ret *half)
+{
+    ee_u32   i, kept = t->last_kept - t->first_kept + 1;
+    secs_ret var = 0;
+    *mean        = 0;
+    for (i = t->first_kept; i <= t->last_kept; i++)
+        *mean += trial_rate(t, t->order[i]);
+    *mean /= kept;
+    for (i = t->first_kept; i <= t->last_kept; i++)
+        var += (trial_rate(t, t->order[i]) - *mean)
+               * (trial_rate(t, t->order[i]) - *mean);
+    if (kept > 1)
+        var /= kept - 1;
+    *sd   = stat_sqrt(var);
+    *half = 0;
+    if (kept > 1)
+        *half = ((kept - 1 <= 30) ? student_t95[kept - 2] : 1.96) * *sd
+                / stat_sqrt(kept);
+}
+#endif
+/* Function: report_trials
+        Report every trial, then the minimum, median, mean and standard
+   deviation of the throughput of the kept trials and the 95% confidence
+   interval of their mean.
+*/
+static void
+report_trials(core_trials *t)
+{
+    ee_u32 i, kept = t->last_kept - t->first_kept + 1;
+#if HAS_FLOAT
+    secs_ret mean, sd, half;
+#endif
+    for (i = 0; i < t->num; i++)
+    {
+        ee_u8 rejected = trial_rejected(t, i);
+#if HAS_FLOAT
+        ee_printf("(%d)Iterations/Sec: %f%s\n",
+                  i,
+                  trial_rate(t, i),
+                  rejected ? " rejected" : "");
+#else
+        ee_printf("(%d)ticks         : %lu%s\n",
+                  i,
+                  (long unsigned)t->ticks[i],
+                  rejected ? " rejected" : "");
+#endif
+    }
+    ee_printf("Trials           : %lu, %lu rejected\n",
+              (long unsigned)t->num,
+              (long unsigned)(t->num - kept));
+#if HAS_FLOAT
+    trials_stats(t, &mean, &sd, &half);
+    ee_printf("Minimum          : %f\n",
+              trial_rate(t, t->order[t->first_kept]));
+    ee_printf("Median           : %f\n", trial_rate(t, trials_median(t)));
+    ee_printf("Mean             : %f\n", mean);
+    ee_printf("Std deviation    : %f\n", sd);
+    ee_printf("95%% confidence   : %f - %f\n", mean - half, mean + half);
+#endif
+}
+#if LATENCY_HISTOGRAM
+static void
+report_latency_line(core_latency *lat)
+{
+    ee_printf(": p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n",
+              (long unsigned)latency_percentile(lat, 500),
+              (long unsigned)latency_percentile(lat, 900),
+              (long unsigned)latency_percentile(lat, 990),
+              (long unsigned)latency_percentile(lat, 999),
+              (long unsigned)lat->max);
+}
+/* Function: report_latency
+        Report the latency percentiles of an iteration in nanoseconds, for
+   every context and over all of them. With several trials these are the
+   latencies of the last one.
+*/
+static void
+report_latency(core_results *results, ee_u32 num_contexts)
+{
+    static core_latency all;
+    ee_u32              i;
+    latency_reset(&all);
+    for (i = 0; i < num_contexts; i++)
+    {
+        if (num_contexts > 1)
+        {
+            ee_printf("[%d]latency ns    ", i);
+            report_latency_line(&results[i].latency);
+        }
+        latency_merge(&all, &results[i].latency);
+    }
+    ee_printf("Latency ns       ");
+    report_latency_line(&all);
+}
+#endif
+#if KERNEL_PROFILE
+static char *kernel_name[NUM_KERNELS] = { "list find",
+                                           "list reverse",
+                                           "list mergesort",
+                                           "calc_func hit",
+                                           "calc_func miss",
+                                           "matrix add const",
+                                           "matrix mul const",
+                                           "matrix mul vect",
+                                           "matrix mul matrix",
+                                           "matrix bitextract",
+                                           "matrix sum",
+                                           "state scan",
+                                           "state corrupt",
+                                           "state rescan",
+                                           "state restore" };
+/* Function: report_profile
+        Report the calls and time per kernel summed over all contexts, see
+   <core_profile>. With several trials these are the numbers of the last one.
+*/
+static void
+report_profile(core_results *results, ee_u32 num_contexts)
+{
+    ee_u32 i, k;
+    for (k = 0; k < NUM_KERNELS; k++)
+    {
+        ee_u64 calls = 0, ns = 0;
+        for (i = 0; i < num_contexts; i++)
+        {
+            calls += results[i].profile.calls[k];
+            ns += results[i].profile.ns[k];
+        }
+        if (k == KERNEL_CALC_HIT)
+            ee_printf(
+                "%-17s: %lu calls\n", kernel_name[k], (long unsigned)calls);
+        else
+            ee_printf("%-17s: %lu calls, %lu ns, %lu ns/call\n",
+                      kernel_name[k],
+                      (long unsigned)calls,
+                      (long unsigned)ns,
+                      (long unsigned)(calls ? ns / calls : 0));
+    }
+}
+#endif
+#if PERF_COUNTERS
+static char *counter_name[NUM_COUNTERS] = { "Cycles",
+                                            "Instructions",
+                                            "Branch misses",
+                                            "L1D misses",
+                                            "LLC misses",
+                                            "Task clock ns",
+                                            "Context switches",
+                                            "Page faults" };
+#if HAS_FLOAT
+/* Function: report_rates
+        Report instructions per cycle and CoreMark/GHz, the iterations run per
+   billion cycles, of one context or, with <context> -1, of all of them.
+*/
+static void
+report_rates(ee_s32 context, core_counters *c, ee_u64 iterations)
+{
+    ee_u32 needed = (1 << COUNTER_CYCLES) | (1 << COUNTER_INSTRUCTIONS);
+    if (((c->valid & needed) != needed) || (c->value[COUNTER_CYCLES] == 0))
+        return;
+    if (context >= 0)
+        ee_printf("[%d]IPC           : %f\n[%d]CoreMark/GHz  : %f\n",
+                  context,
+                  (double)c->value[COUNTER_INSTRUCTIONS]
+                      / c->value[COUNTER_CYCLES],
+                  context,
+                  iterations * 1e9 / c->value[COUNTER_CYCLES]);
+    else
+        ee_printf("IPC              : %f\nCoreMark/GHz     : %f\n",
+                  (double)c->value[COUNTER_INSTRUCTIONS]
+                      / c->value[COUNTER_CYCLES],
+                  iterations * 1e9 / c->value[COUNTER_CYCLES]);
+}
+#endif
+/* Function: report_counters
+        Report the performance counters of the timed region summed over all
+   contexts, and the rates derived from them for each context and in total.
+   CoreMark/GHz of several contexts is per core: their iterations over their
+   cycles. With several trials these are the numbers of the last one.
+*/
+static void
+report_counters(core_results *results, ee_u32 num_contexts)
+{
+    core_counters total;
+    ee_u64        iterations = 0;
+    ee_u32        i, k;
+    counters_reset(&total);
+    for (i = 0; i < num_contexts; i++)
+    {
+        total.valid &= results[i].counters.valid;
+        for (k = 0; k < NUM_COUNTERS; k++)
+            total.value[k] += results[i].counters.value[k];
+        iterations += results[i].iterations;
+#if HAS_FLOAT
+        if (num_contexts > 1)
+            report_rates(i, &results[i].counters, results[i].iterations);
+#endif
+    }
+    if (total.valid == 0)
+        ee_printf("Counters         : unavailable\n");
+    else if ((total.valid & (1 << COUNTER_CYCLES)) == 0)
+        ee_printf("Counters         : software only\n");
+    for (k = 0; k < NUM_COUNTERS; k++)
+        if (total.valid & (1 << k))
+            ee_printf("%-17s: %lu\n",
+                      counter_name[k],
+                      (long unsigned)total.value[k]);
+#if HAS_FLOAT
+    report_rates(-1, &total, iterations);
+#endif
+}
+#endif
+/* Function: calibrate
+        Find a number of iterations that runs for about <secs>,
+   <CALIBRATION_SECS> for the reported run.
+
+        A probe is timed, and the next one is sized from the rate it measured
+   so that it runs a bit longer than <CALIBRATION_PROBE_SECS>. Probes too
+   short to measure a rate grow tenfold. Once a probe has run long enough,
+   <CALIBRATION_PROBES> more of the same size are timed warm, and the fastest
+   rate is extrapolated. Calibration thus costs about a second rather than up
+   to 10 seconds, and the timed run does not fall short of <secs> when the
+   first probe was slowed by cold caches. Without floating point the time is
+   only known in whole seconds, and the number of iterations grows tenfold
+   until a probe runs for at least 1 second.
+
+        The iterations run and the ticks spent are added to <warmup_iterations>
+   and <warmup_ticks>.
+
+        Returns:
+        The number of iterations for the timed run.
+*/
+static ee_u32
+calibrate(core_results *res,
+          secs_ret      secs,
+          ee_u64       *warmup_iterations,
+          CORE_TICKS   *warmup_ticks)
+{
+    CORE_TICKS ticks;
+    secs_ret   secs_passed = 0;
+#if HAS_FLOAT
+    secs_ret fastest = 0;
+    ee_u32   probes = 0;
+    res->iterations = 1;
+    for (;;)
+    {
+        start_time();
+        iterate(res);
+        stop_time();
+        ticks       = get_time();
+        secs_passed = time_in_secs(ticks);
+        *warmup_iterations += res->iterations;
+        *warmup_ticks += ticks;
+        if (probes > 0)
+        {
+            if (secs_passed < fastest)
+                fastest = secs_passed;
+            if (++probes > CALIBRATION_PROBES)
+                break;
+            continue;
+        }
+        if (secs_passed >= CALIBRATION_PROBE_SECS)
+        {
+            fastest = secs_passed;
+            probes  = 1;
+            continue;
+        }
+        if (secs_passed < CALIBRATION_PROBE_SECS / 100)
+            res->iterations *= 10;
+        else
+            res->iterations = (ee_u32)(res->iterations
+                                       * (CALIBRATION_PROBE_SECS * 1.25)
+                                       / secs_passed)
+                              + 1;
+    }
+    return (ee_u32)(res->iterations * (secs / fastest)) + 1;
+#else
+    ee_u32 divisor;
+    res->iterations = 1;
+    while (secs_passed < (secs_ret)1)
+    {
+        res->iterations *= 10;
+        start_time();
+        iterate(res);
+        stop_time();
+        ticks       = get_time();
+        secs_passed = time_in_secs(ticks);
+        *warmup_iterations += res->iterations;
+        *warmup_ticks += ticks;
+    }
+    /* now we know it executes for at least 1 sec, set actual run time at
+     * about MIN_RUN_SECS */
+    divisor = (ee_u32)secs_passed;
+    return res->iterations * (1 + MIN_RUN_SECS / divisor);
+#endif
+}
+/* Function: calibrate_iterations
+        Set the iterations of the first context with <calibrate>, unless they
+   were given or contexts run for <default_duration>. With multiple contexts
+   the calibration runs on a scratch copy of the first context, as the data
+   of the contexts is only initialized once they are started.
+
+        Returns:
+        0 on success, 1 if no memory block could be acquired.
+*/
+static ee_u8
+calibrate_iterations(core_results *results,
+                     secs_ret      secs,
+                     ee_u64       *warmup_iterations,
+                     CORE_TICKS   *warmup_ticks)
+{
+    core_results *calib = &results[0];
+#if (MULTITHREAD > 1)
+    core_results scratch;
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+    ee_u8 scratch_memblock[TOTAL_DATA_SIZE];
+#endif
+    if ((results[0].iterations != 0) || (default_duration > 0))
+        return 0;
+    scratch = results[0];
+    calib   = &scratch;
+#if (MEM_METHOD == MEM_MALLOC)
+    /* the scratch copy gets memory blocks of its own */
+    scratch.memblock[0] = NULL;
+    scratch.list_block  = NULL;
+#elif (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+    scratch.memblock[0] = scratch_memblock;
+#endif
+    if (core_init_context(calib))
+        return 1;
+#else
+    if (results[0].iterations != 0)
+        return 0;
+#endif
+    results[0].iterations
+        = calibrate(calib, secs, warmup_iterations, warmup_ticks);
+#if (MULTITHREAD > 1) && (MEM_METHOD == MEM_MALLOC)
+    portable_memblock_free(scratch.memblock[0]);
+    portable_memblock_free(scratch.list_block);
+#endif
+    return 0;
+}
+/* Function: core_context_size
+        Bytes of the memory block of a context: <res->size> for each enabled
+   algorithm and, for a list of <default_list_items> items, the list, aligned
+   past them.
+*/
+ee_u32
+core_context_size(core_results *res)
+{
+    ee_u32 i, size = 0;
+    for (i = 0; i < NUM_ALGORITHMS; i++)
+    {
+        if ((1 << (ee_u32)i) & res->execs)
+            size += res->size;
+    }
+#if (MEM_METHOD == MEM_MALLOC)
+    if ((default_list_items > 0) && (res->execs & ID_LIST))
+        size = LIST_ALIGN(size) + LIST_BLOCK(default_list_items);
+#endif
+    return size;
+}
+/* Function: core_init_context
+        Initialize the data of one context.
+
+        Acquires the memory block of the context if it does not have one yet,
+   divides it between the enabled algorithms and initializes the data for
+   each of them. <results->size> must already be set to the size available
+   per algorithm.
+
+        With multiple contexts the port calls this from the context itself,
+   so that the data is first touched by the cpu that will work on it. With
+   <CONTEXT_STACK> the port also provides the memory block, from the stack of
+   the thread or process that calls this.
+
+        Returns:
+        0 on success, 1 if no memory block could be acquired.
+*/
+ee_u8
+core_init_context(core_results *res)
+{
+    ee_u32 i, j = 0, list_size = res->size;
+#if (MEM_METHOD == MEM_MALLOC)
+    if (res->memblock[0] == NULL)
+    {
+        res->memblock[0]
+            = portable_memblock_alloc(core_context_size(res), res);
+        if (res->memblock[0] == NULL)
+        {
+            ee_printf("ERROR! Cannot allocate memory for a context!\n");
+            return 1;
+        }
+    }
+    if ((default_list_footprint > 0) && (res->execs & ID_LIST)
+        && (res->list_block == NULL))
+    {
+        res->list_block = portable_memblock_alloc(default_list_footprint, res);
+        if (res->list_block == NULL)
+        {
+            ee_printf("ERROR! Cannot allocate the list footprint!\n");
+            return 1;
+        }
+    }
+#elif (MEM_METHOD == MEM_STACK) && (MULTITHREAD > 1) && CONTEXT_STACK
+    if (res->memblock[0] == NULL)
+    {
+        ee_printf("ERROR! No stack memory for a context!\n");
+        return 1;
+    }
+#endif
+    /* Assign pointers */
+    for (i = 0; i < NUM_ALGORITHMS; i++)
+    {
+        if ((1 << (ee_u32)i) & res->execs)
+        {
+            res->memblock[i + 1] = (char *)(res->memblock[0]) + res->size * j;
+            j++;
+        }
+    }
+#if (MEM_METHOD == MEM_MALLOC)
+    /* a list of a given length lives past the data of all algorithms */
+    if (default_list_items > 0)
+    {
+        res->memblock[1]
+            = (char *)(res->memblock[0]) + LIST_ALIGN(res->size * j);
+        list_size = LIST_BLOCK(default_list_items);
+    }
+#endif
+    /* call inits */
+#if (LIST_LINKS == LIST_OFFSET16)
+    if ((res->execs & ID_LIST) && (LIST_ITEMS(list_size) > LIST_OFFSET16_ITEMS))
+    {
+        ee_printf("ERROR! A list of %lu items is too long for 16b links!\n",
+                  (long unsigned)LIST_ITEMS(list_size));
+        return 1;
+    }
+#if (MEM_METHOD == MEM_MALLOC)
+    if (default_list_footprint > 0x7fff * LIST_LINK_UNIT)
+    {
+        ee_printf("ERROR! A list footprint of %lu bytes is too large for 16b "
+                  "links!\n",
+                  (long unsigned)default_list_footprint);
+        return 1;
+    }
+#endif
+#endif
+    if (res->execs & ID_LIST)
+    {
+        res->list = core_list_init(list_size, res->memblock[1], res->seed1);
+#if (MEM_METHOD == MEM_MALLOC)
+        if (res->list_block != NULL)
+            res->list = core_list_scatter(
+                res->list, res->list_block, default_list_footprint, res->seed1);
+        if (res->list == NULL)
+        {
+            ee_printf("ERROR! A list footprint of %lu bytes is too small!\n",
+                      (long unsigned)default_list_footprint);
+            return 1;
+        }
+#endif
+    }
+    if (res->execs & ID_MATRIX)
+    {
+        core_init_matrix(res->size,
+                         res->memblock[2],
+                         (ee_s32)res->seed1 | (((ee_s32)res->seed2) << 16),
+                         &(res->mat));
+    }
+    if (res->execs & ID_STATE)
+    {
+        core_init_state(res->size, res->seed1, res->memblock[3]);
+    }
+    return 0;
+}
+
+/* Function: run_trials
+        Run the timed section <trials.num> times on the same data with
+   <default_num_contexts> contexts, then order the trials by throughput and
+   reject the outliers.
+
+        Returns:
+        The number of trials whose CRCs differ from those of the first one,
+   or -1 if a context could not be started, did not reach the start barrier
+   or failed.
+*/
+static ee_s16
+run_trials(core_results *results)
+{
+    ee_u32     i, trial;
+#if (MULTITHREAD > 1)
+    ee_u32 started, failed;
+#endif
+    ee_s16     errors    = 0;
+    ee_u16     first_crc = 0;
+    CORE_TICKS total_time;
+#if (MULTITHREAD == 1) && PERF_COUNTERS
+    core_counters counters_begin, counters_end;
+#endif
+    for (trial = 0; trial < trials.num; trial++)
+    {
+        ee_u16 trial_crc = 0;
+#if (MULTITHREAD > 1)
+        /* contexts are parked on a barrier once created, so thread or
+         * process creation is not part of the timed region */
+        for (started = 0; started < default_num_contexts; started++)
+        {
+            results[started].iterations = results[0].iterations;
+            results[started].execs      = results[0].execs;
+            /* a context that fails must not look like it ran */
+            results[started].crc       = 0;
+            results[started].crclist   = 0;
+            results[started].crcmatrix = 0;
+            results[started].crcstate  = 0;
+            if (core_start_parallel(&results[started]))
+                break;
+        }
+        if (core_wait_parallel())
+        {
+            /* let the contexts that did park go, and reap them all */
+            core_release_parallel();
+            for (i = 0; i < started; i++)
+                core_stop_parallel(&results[i]);
+            ee_printf("ERROR! Contexts did not reach the start barrier\n");
+            return -1;
+        }
+        start_time();
+        core_release_parallel();
+        failed = 0;
+        for (i = 0; i < started; i++)
+        {
+            if (core_stop_parallel(&results[i]))
+                failed++;
+        }
+        stop_time();
+        total_time = get_time();
+        if (started < default_num_contexts)
+        {
+            ee_printf("ERROR! Could not start context %u of %u\n",
+                      started,
+                      default_num_contexts);
+            return -1;
+        }
+        if (failed > 0)
+        {
+            ee_printf("ERROR! %u of %u contexts failed in trial %u\n",
+                      failed,
+                      default_num_contexts,
+                      trial);
+            return -1;
+        }
+#else
+        /* the counters are opened and read outside of the timed region */
+#if PERF_COUNTERS
+        portable_counters_read(&counters_begin);
+#endif
+        start_time();
+        iterate(&results[0]);
+        stop_time();
+#if PERF_COUNTERS
+        portable_counters_read(&counters_end);
+        counters_reset(&results[0].counters);
+        counters_add(&results[0].counters, &counters_begin, &counters_end);
+#endif
+        total_time             = get_time();
+        results[0].start_ticks = 0;
+        results[0].stop_ticks  = total_time;
+#endif
+        /* accumulate in 64b, many contexts times many iterations overflows
+         * 32b */
+        trials.ticks[trial]      = total_time;
+        trials.iterations[trial] = 0;
+        for (i = 0; i < default_num_contexts; i++)
+        {
+            trials.iterations[trial] += results[i].iterations;
+            trial_crc = crcu16(results[i].crc, trial_crc);
+        }
+        /* every trial runs the same iterations on the same data */
+        if (trial == 0)
+            first_crc = trial_crc;
+#if (MULTITHREAD > 1)
+        else if ((trial_crc != first_crc) && (default_duration == 0))
+#else
+        else if (trial_crc != first_crc)
+#endif
+        {
+            if (default_output_format == OUTPUT_TEXT)
+                ee_printf("(%u)ERROR! crc 0x%04x - should be 0x%04x\n",
+                          trial,
+                          trial_crc,
+                          first_crc);
+            errors++;
+        }
+    }
+    trials_sort(&trials);
+#if HAS_FLOAT
+    trials_reject(&trials);
+#endif
+    return errors;
+}
+#if (MULTITHREAD > 1)
+/* Sweep:
+        Ticks and iterations of the median trial of every step of a scaling
+   sweep, see default_sweep. The last step is the reported run itself.
+*/
+static CORE_TICKS sweep_ticks[MAX_SWEEP_STEPS];
+static ee_u64     sweep_iterations[MAX_SWEEP_STEPS];
+
+/* Function: sweep_contexts
+        Run every step of the sweep but the last, each with its number of
+   contexts taken from the start of <results>. A step runs <trials.num>
+   trials and keeps its median one. Contexts keep their memory blocks from
+   one step to the next, and the contexts of a step are started, parked and
+   released exactly as for the reported run.
+
+        Returns:
+        The number of trials whose CRCs differ from the first trial of their
+   step, plus the number of contexts whose CRC differs from the first context
+   of their step, or -1 if a context could not be started.
+*/
+static ee_s16
+sweep_contexts(core_results *results)
+{
+    ee_u32 all = default_num_contexts, step, i, median;
+    ee_s16 errors = 0, trial_errors;
+    /* the stack holds fewer contexts than the sweep asked for */
+    while ((default_num_sweep > 1)
+           && (default_sweep[default_num_sweep - 2] >= all))
+        default_num_sweep--;
+    default_sweep[default_num_sweep - 1] = all;
+    for (step = 0; step + 1 < default_num_sweep; step++)
+    {
+        default_num_contexts = default_sweep[step];
+        trial_errors         = run_trials(results);
+        if (trial_errors < 0)
+            return -1;
+        errors += trial_errors;
+        median                 = trials_median(&trials);
+        sweep_ticks[step]      = trials.ticks[median];
+        sweep_iterations[step] = trials.iterations[median];
+        if (default_duration > 0)
+            continue;
+        for (i = 1; i < default_num_contexts; i++)
+            if (results[i].crc != results[0].crc)
+            {
+                if (default_output_format == OUTPUT_TEXT)
+                    ee_printf("{%u}ERROR! [%u]crcfinal 0x%04x - should be "
+                              "0x%04x\n",
+                              default_num_contexts,
+                              i,
+                              results[i].crc,
+                              results[0].crc);
+                errors++;
+            }
+    }
+    default_num_contexts = all;
+    return errors;
+}
+#if HAS_FLOAT
+static secs_ret
+sweep_rate(ee_u32 step)
+{
+    if (time_in_secs(sweep_ticks[step]) > 0)
+        return sweep_iterations[step] / time_in_secs(sweep_ticks[step]);
+    return 0;
+}
+/* Function: sweep_efficiency
+        Parallel efficiency of a step in percent: its throughput per context
+   relative to the throughput of one context, the first step.
+*/
+static secs_ret
+sweep_efficiency(ee_u32 step)
+{
+    if (sweep_rate(0) > 0)
+        return 100 * sweep_rate(step) / default_sweep[step] / sweep_rate(0);
+    return 0;
+}
+#endif
+/* Function: report_sweep
+        Report the throughput of every step of the sweep, per context and as
+   parallel efficiency, see <sweep_efficiency>.
+*/
+static void
+report_sweep(void)
+{
+    ee_u32 step;
+    for (step = 0; step < default_num_sweep; step++)
+#if HAS_FLOAT
+        ee_printf("{%u}Iterations/Sec: %f, %f per context, %f%% efficiency\n",
+                  default_sweep[step],
+                  sweep_rate(step),
+                  sweep_rate(step) / default_sweep[step],
+                  sweep_efficiency(step));
+#else
+        ee_printf("{%u}ticks         : %lu, %lu iterations\n",
+                  default_sweep[step],
+                  (long unsigned)sweep_ticks[step],
+                  (long unsigned)sweep_iterations[step]);
+#endif
+}
+/* Cpu scan:
+        Every cpu of a cpu scan, see default_scan, in the order scanned: the
+   cpu its context ran on, -1 if unknown, the ticks and iterations of that
+   context, its CRCs, and whether they match those of the reported run, 1,
+   or not, 0. <order> lists the cpus from the slowest to the fastest.
+*/
+typedef struct CORE_SCAN_CPU_S
+{
+    ee_s32     cpu;
+    CORE_TICKS ticks;
+    ee_u64     iterations;
+    ee_u16     crclist;
+    ee_u16     crcmatrix;
+    ee_u16     crcstate;
+    ee_s16     valid;
+    ee_u32     order;
+} core_scan_cpu;
+
+static core_scan_cpu *scan_cpus = NULL;
+
+/* Function: scan_run
+        Run the cpu scan: calibrate the iterations to run for about
+   <SCAN_SECS>, then run a single trial on every cpu of the scan, one
+   context at a time or, for SCAN_PARALLEL, up to all contexts at a time.
+   The port pins the contexts to the cpus from <default_scan_step> on. Each
+   cpu keeps the ticks and iterations of its own context.
+
+        Returns:
+        0 on success, 1 if the scan could not be allocated or calibrated, or
+   a context could not be started.
+*/
+static ee_u8
+scan_run(core_results *results)
+{
+    ee_u32     all = default_num_contexts, num = trials.num, batch, first, i;
+    ee_u32     iterations = results[0].iterations;
+    ee_u64     probe_iterations = 0;
+    CORE_TICKS probe_ticks = 0;
+    scan_cpus = (core_scan_cpu *)portable_malloc(default_num_scan_cpus
+                                                 * sizeof(core_scan_cpu));
+    if (scan_cpus == NULL)
+    {
+        ee_printf("ERROR! Cannot allocate the scan of %lu cpus!\n",
+                  (long unsigned)default_num_scan_cpus);
+        return 1;
+    }
+    results[0].iterations = 0;
+    if (calibrate_iterations(
+            results, SCAN_SECS, &probe_iterations, &probe_ticks))
+        return 1;
+    batch      = (default_scan == SCAN_PARALLEL) ? all : 1;
+    trials.num = 1;
+    for (first = 0; first < default_num_scan_cpus; first += batch)
+    {
+        default_num_contexts = default_num_scan_cpus - first;
+        if (default_num_contexts > batch)
+            default_num_contexts = batch;
+        default_scan_step = first;
+        if (run_trials(results) < 0)
+            return 1;
+        for (i = 0; i < default_num_contexts; i++)
+        {
+            core_scan_cpu *c = &scan_cpus[first + i];
+            c->cpu           = results[i].cpu;
+            c->ticks         = results[i].stop_ticks - results[i].start_ticks;
+            c->iterations    = results[i].iterations;
+            c->crclist       = results[i].crclist;
+            c->crcmatrix     = results[i].crcmatrix;
+            c->crcstate      = results[i].crcstate;
+        }
+    }
+    default_scan_step     = -1;
+    default_num_contexts  = all;
+    trials.num            = num;
+    results[0].iterations = iterations;
+    return 0;
+}
+/* Function: scan_validate
+        Check the CRCs of every cpu of the scan against those of the first
+   context of the reported run, which are validated against the known CRCs,
+   and order the cpus by throughput as <trials_sort> does the trials.
+
+        Returns:
+        The number of cpus whose CRCs are wrong.
+*/
+static ee_s16
+scan_validate(core_results *results)
+{
+    ee_u32 i, j;
+    ee_s16 errors = 0;
+    for (i = 0; i < default_num_scan_cpus; i++)
+    {
+        core_scan_cpu *c = &scan_cpus[i];
+        ee_u32         cur;
+        c->valid         = (c->crclist == results[0].crclist)
+                   && (c->crcmatrix == results[0].crcmatrix)
+                   && (c->crcstate == results[0].crcstate);
+        if (!c->valid)
+            errors++;
+        cur = scan_cpus[i].order = i;
+        for (j = i; j > 0; j--)
+        {
+            ee_u32 prev = scan_cpus[j - 1].order;
+            if (scan_cpus[prev].iterations * scan_cpus[cur].ticks
+                <= scan_cpus[cur].iterations * scan_cpus[prev].ticks)
+                break;
+            scan_cpus[j].order = prev;
+        }
+        scan_cpus[j].order = cur;
+    }
+    return errors;
+}
+#if HAS_FLOAT
+static secs_ret
+scan_rate(ee_u32 i)
+{
+    if (time_in_secs(scan_cpus[i].ticks) > 0)
+        return scan_cpus[i].iterations / time_in_secs(scan_cpus[i].ticks);
+    return 0;
+}
+/* Function: scan_median
+        Median throughput of the scan, that of the slower of the two middle
+   cpus for an even count, as for <trials_median>.
+*/
+static secs_ret
+scan_median(void)
+{
+    return scan_rate(scan_cpus[(default_num_scan_cpus - 1) / 2].order);
+}
+/* Function: scan_deviation
+        Deviation of the throughput of a cpu of the scan from the median, in
+   percent.
+*/
+static secs_ret
+scan_deviation(ee_u32 i)
+{
+    if (scan_median() > 0)
+        return 100 * (scan_rate(i) - scan_median()) / scan_median();
+    return 0;
+}
+static ee_u8
+scan_outlier(ee_u32 i)
+{
+    secs_ret d = scan_deviation(i);
+    return (d > default_scan_deviation) || (-d > default_scan_deviation);
+}
+#endif
+/* Function: report_scan
+        Report the throughput of every cpu of the scan, how far it is from
+   the median, whether it is an outlier and whether its CRCs were validated.
+*/
+static void
+report_scan(void)
+{
+    ee_u32 i, outliers = 0;
+    for (i = 0; i < default_num_scan_cpus; i++)
+    {
+        core_scan_cpu *c = &scan_cpus[i];
+        char          *valid = c->valid ? "" : ", ERROR! wrong crc";
+#if HAS_FLOAT
+        outliers += scan_outlier(i);
+        ee_printf("<%ld>Iterations/Sec: %f, %+.1f%% from median%s%s\n",
+                  (long)c->cpu,
+                  scan_rate(i),
+                  scan_deviation(i),
+                  scan_outlier(i) ? ", OUTLIER" : "",
+                  valid);
+#else
+        ee_printf("<%ld>ticks         : %lu, %lu iterations%s\n",
+                  (long)c->cpu,
+                  (long unsigned)c->ticks,
+                  (long unsigned)c->iterations,
+                  valid);
+#endif
+    }
+#if HAS_FLOAT
+    ee_printf("CPU scan         : %s, %lu cpus, median %f Iterations/Sec, %lu "
+              "beyond %lu%%\n",
+              (default_scan == SCAN_PARALLEL) ? "parallel" : "serial",
+              (long unsigned)default_num_scan_cpus,
+              scan_median(),
+              (long unsigned)outliers,
+              (long unsigned)default_scan_deviation);
+#else
+    ee_printf("CPU scan         : %s, %lu cpus\n",
+              (default_scan == SCAN_PARALLEL) ? "parallel" : "serial",
+              (long unsigned)default_num_scan_cpus);
+    (void)outliers;
+#endif
+}
+#endif
+#if (MEM_METHOD == MEM_MALLOC)
+/* Size sweep:
+        Every step of a data size sweep, see default_size_sweep: its size,
+   the ticks and iterations of its median trial, the CRCs of the first
+   context, and whether they were validated, 1, wrong, 0, or could not be
+   checked, -1.
+*/
+typedef struct CORE_SIZE_STEP_S
+{
+    ee_u32     size;
+    CORE_TICKS ticks;
+    ee_u64     iterations;
+    ee_u16     crclist;
+    ee_u16     crcmatrix;
+    ee_u16     crcstate;
+    ee_s16     valid;
+} core_size_step;
+
+static core_size_step size_steps[MAX_SWEEP_STEPS];
+
+/* CRCs of the list, matrix and state at each of <SIZE_SWEEP_SIZES>, for
+ * the performance seeds, 0 0 0x66, and the validation seeds, 0x3415 0x3415
+ * 0x66, with all algorithms. The data layout does not depend on the
+ * platform, so neither do these. */
+typedef struct CORE_SIZE_KNOWN_S
+{
+    ee_u32 size;
+    ee_s16 seed;
+    ee_u16 crclist;
+    ee_u16 crcmatrix;
+    ee_u16 crcstate;
+} core_size_known;
+
+static core_size_known size_known_crc[] = {
+    { 2000, 0, 0xe714, 0x1fd7, 0x8e3a },
+    { 4096, 0, 0x280e, 0x8dab, 0x4e1a },
+    { 8192, 0, 0x6cb8, 0x2ef1, 0x70e4 },
+    { 16384, 0, 0x93f3, 0x0f41, 0xa9cd },
+    { 32768, 0, 0x5376, 0xcc3b, 0xa98b },
+    { 65536, 0, 0xeb24, 0x2b69, 0x8bf7 },
+    { 131072, 0, 0x3521, 0xc3b2, 0xe3b4 },
+    { 262144, 0, 0x602c, 0x6810, 0x0dd6 },
+    { 2000, 0x3415, 0xe3c1, 0x0747, 0x8d84 },
+    { 4096, 0x3415, 0x3093, 0x6a68, 0xeab1 },
+    { 8192, 0x3415, 0xe111, 0x5086, 0x5950 },
+    { 16384, 0x3415, 0x0533, 0xa4b3, 0xc0b4 },
+    { 32768, 0x3415, 0xd334, 0xb94b, 0x21bc },
+    { 65536, 0x3415, 0xa2f8, 0xa309, 0x85df },
+    { 131072, 0x3415, 0x1137, 0x2853, 0x1f42 },
+    { 262144, 0x3415, 0xae06, 0xce97, 0xe41b }
+};
+
+#if LIST_WIDE
+/* CRCs of a list of <default_list_items> items, in place of the size, for
+ * the 2K performance and validation runs: seeds 0 0 0x66 and 0x3415 0x3415
+ * 0x66, with the matrix and state at 666 bytes each. */
+static core_size_known list_items_known_crc[] = {
+    { 4096, 0, 0xec06, 0xe018, 0xe10b },
+    { 65536, 0, 0x389c, 0xe018, 0xe10b },
+    { 1048576, 0, 0x4a30, 0xe018, 0xe10b },
+    { 4096, 0x3415, 0x518b, 0x518e, 0xdf32 },
+    { 65536, 0x3415, 0x9e49, 0x518e, 0xdf32 },
+    { 1048576, 0x3415, 0x6c2b, 0x518e, 0xdf32 }
+};
+#endif
+
+/* Function: size_resize
+        Give every context data of <size> bytes per algorithm. Memory blocks
+   are acquired again at the new size by <core_init_context>, which with
+   multiple contexts runs once the contexts are started.
+
+        Returns:
+        0 on success, 1 if no memory block could be acquired.
+*/
+static ee_u8
+size_resize(core_results *results, ee_u32 size)
+{
+    ee_u32 i;
+    for (i = 0; i < default_num_contexts; i++)
+    {
+        portable_memblock_free(results[i].memblock[0]);
+        results[i].memblock[0] = NULL;
+        results[i].size        = size;
+    }
+#if (MULTITHREAD > 1)
+    return 0;
+#else
+    return core_init_context(&results[0]);
+#endif
+}
+/* Function: size_validate
+        Check the CRCs of every context at a step of the sweep against those
+   of the first context and, for the performance and validation seeds at
+   one of <SIZE_SWEEP_SIZES>, against <size_known_crc>.
+
+        Returns:
+        1 if validated, 0 for a wrong CRC, -1 if there is no reference.
+*/
+static ee_s16
+size_validate(core_results *results, core_size_step *step)
+{
+    ee_u32 i;
+    ee_s16 valid = -1;
+#if (MULTITHREAD > 1)
+    for (i = 1; i < default_num_contexts; i++)
+        if ((results[i].crclist != step->crclist)
+            || (results[i].crcmatrix != step->crcmatrix)
+            || (results[i].crcstate != step->crcstate))
+            return 0;
+#endif
+    if ((results[0].execs != ALL_ALGORITHMS_MASK)
+        || (results[0].seed1 != results[0].seed2) || (results[0].seed3 != 0x66)
+        || LIST_WIDE || (default_list_items > 0))
+        return -1;
+    for (i = 0; i < sizeof(size_known_crc) / sizeof(size_known_crc[0]); i++)
+        if ((size_known_crc[i].size == step->size)
+            && (size_known_crc[i].seed == results[0].seed1))
+            valid = (size_known_crc[i].crclist == step->crclist)
+                    && (size_known_crc[i].crcmatrix == step->crcmatrix)
+                    && (size_known_crc[i].crcstate == step->crcstate);
+    return valid;
+}
+/* Function: size_sweep
+        Run every step of the data size sweep: initialize the data of all
+   contexts at the size of the step, calibrate the iterations to run for about
+   <SIZE_SWEEP_SECS>, as the time of an iteration grows with the size, and
+   run <trials.num> trials, keeping the median one. The data is then
+   initialized again at <size>, the size per algorithm of the reported run.
+
+        Returns:
+        The number of errors: trials whose CRCs differ from the first trial of
+   their step and steps whose CRCs are wrong. -1 if no memory block could be
+   acquired or a context could not be started.
+*/
+static ee_s16
+size_sweep(core_results *results, ee_u32 size, ee_u32 num_algorithms)
+{
+    ee_u32     step, median, iterations = results[0].iterations;
+    ee_s16     errors = 0, trial_errors;
+    ee_u64     probe_iterations = 0;
+    CORE_TICKS probe_ticks = 0;
+    for (step = 0; step < default_num_size_sweep; step++)
+    {
+        core_size_step *s     = &size_steps[step];
+        s->size               = default_size_sweep[step];
+        results[0].iterations = 0;
+        if (size_resize(results, s->size / num_algorithms)
+            || calibrate_iterations(
+                results, SIZE_SWEEP_SECS, &probe_iterations, &probe_ticks))
+            return -1;
+        trial_errors = run_trials(results);
+        if (trial_errors < 0)
+            return -1;
+        errors += trial_errors;
+        median        = trials_median(&trials);
+        s->ticks      = trials.ticks[median];
+        s->iterations = trials.iterations[median];
+        s->crclist    = results[0].crclist;
+        s->crcmatrix  = results[0].crcmatrix;
+        s->crcstate   = results[0].crcstate;
+        s->valid      = size_validate(results, s);
+        if (s->valid == 0)
+            errors++;
+    }
+    results[0].iterations = iterations;
+    if (size_resize(results, size))
+        return -1;
+    return errors;
+}
+/* Function: report_size_sweep
+        Report the throughput at every step of the data size sweep and
+   whether its CRCs were validated.
+*/
+static void
+report_size_sweep(void)
+{
+    ee_u32 step;
+    for (step = 0; step < default_num_size_sweep; step++)
+    {
+        core_size_step *s = &size_steps[step];
+        char *valid = (s->valid > 0)    ? "validated"
+                      : (s->valid == 0) ? "ERROR! wrong crc"
+                                        : "no reference crc";
+#if HAS_FLOAT
+        ee_printf("Size %-12lu: %f Iterations/Sec, %s\n",
+                  (long unsigned)s->size,
+                  (time_in_secs(s->ticks) > 0)
+                      ? s->iterations / time_in_secs(s->ticks)
+                      : 0,
+                  valid);
+#else
+        ee_printf("Size %-12lu: %lu ticks, %lu iterations, %s\n",
+                  (long unsigned)s->size,
+                  (long unsigned)s->ticks,
+                  (long unsigned)s->iterations,
+                  valid);
+#endif
+    }
+}
+#endif
+/* Function: known_crcs
+        The CRCs the run with the known seeds <known_id> must give: those of
+   the standard run or, for a list of <default_list_items> items, those in
+   <list_items_known_crc>.
 
-    for (i = 0; i < iterations; i++)
+        Returns:
+        1 if they are known, 0 otherwise.
+*/
+static ee_u8
+known_crcs(core_results *res,
+           ee_s16        known_id,
+           ee_u16       *crclist,
+           ee_u16       *crcmatrix,
+           ee_u16       *crcstate)
+{
+    *crclist   = list_known_crc[known_id];
+    *crcmatrix = matrix_known_crc[known_id];
+    *crcstate  = state_known_crc[known_id];
+#if (MEM_METHOD == MEM_MALLOC)
+    if (default_list_items > 0)
     {
-        crc      = core_bench_list(res, 1);
-        res->crc = crcu16(crc, res->crc);
-        crc      = core_bench_list(res, -1);
-        res->crc = crcu16(crc, res->crc);
-        if (i == 0)
-            res->crclist = res->crc;
+#if LIST_WIDE
+        ee_u32 i;
+        for (i = 0;
+             i < sizeof(list_items_known_crc) / sizeof(list_items_known_crc[0]);
+             i++)
+            if ((list_items_known_crc[i].size == default_list_items)
+                && (list_items_known_crc[i].seed == res->seed1)
+                && ((known_id == 3) || (known_id == 4)))
+            {
+                *crclist   = list_items_known_crc[i].crclist;
+                *crcmatrix = list_items_known_crc[i].crcmatrix;
+                *crcstate  = list_items_known_crc[i].crcstate;
+                return 1;
+            }
+#endif
+        return 0;
     }
-    return NULL;
+#endif
+    (void)res;
+    return 1;
 }
+#if OUTPUT_RECORD
+/* Record:
+        The result record while <report_record> formats it. The fields of a
+   CSV row are written twice, first as the header line with <header> set.
+*/
+typedef struct CORE_RECORD_S
+{
+    char  *buf;
+    ee_u32 size;
+    ee_u32 len;
+    ee_u8  csv;
+    ee_u8  header;
+    ee_u8  first; /* no separator before the next field */
+} core_record;
 
-#if (SEED_METHOD == SEED_ARG)
-ee_s32 get_seed_args(int i, int argc, char *argv[]);
-#define get_seed(x)    (ee_s16) get_seed_args(x, argc, argv)
-#define get_seed_32(x) get_seed_args(x, argc, argv)
-#else /* via function or volatile */
-ee_s32 get_seed_32(int i);
-#define get_seed(x) (ee_s16) get_seed_32(x)
+/* bytes reserved for the record of n contexts */
+#define RECORD_SIZE(n) (24576 + (n)*2048)
+
+static void
+record_printf(core_record *r, const char *fmt, ...)
+{
+    va_list args;
+    int     n;
+    if (r->len >= r->size)
+        return;
+    va_start(args, fmt);
+    n = vsnprintf(r->buf + r->len, r->size - r->len, fmt, args);
+    va_end(args);
+    if (n > 0)
+        r->len += n;
+}
+/* Function: record_key
+        Start a field. Keys are written in lower case with blanks as
+   underscores.
+
+        Returns:
+        1 if the value of the field is to be written, 0 on a CSV header line.
+*/
+static ee_u8
+record_key(core_record *r, const char *key)
+{
+    if (!r->first)
+        record_printf(r, ",");
+    r->first = 0;
+    if (r->csv && !r->header)
+        return 1;
+    if (!r->csv)
+        record_printf(r, "\"");
+    for (; *key; key++)
+        if (*key == ' ')
+            record_printf(r, "_");
+        else if ((*key >= 'A') && (*key <= 'Z'))
+            record_printf(r, "%c", *key - 'A' + 'a');
+        else
+            record_printf(r, "%c", *key);
+    if (!r->csv)
+        record_printf(r, "\":");
+    return !r->csv;
+}
+static void
+record_u64(core_record *r, const char *key, ee_u64 value)
+{
+    if (record_key(r, key))
+        record_printf(r, "%lu", (long unsigned)value);
+}
+static void
+record_s32(core_record *r, const char *key, ee_s32 value)
+{
+    if (record_key(r, key))
+        record_printf(r, "%ld", (long)value);
+}
+static void
+record_real(core_record *r, const char *key, secs_ret value)
+{
+    if (record_key(r, key))
+#if HAS_FLOAT
+        record_printf(r, "%f", value);
+#else
+        record_printf(r, "%lu", (long unsigned)value);
+#endif
+}
+static void
+record_crc(core_record *r, const char *key, ee_u16 crc)
+{
+    if (record_key(r, key))
+        record_printf(r, "\"0x%04x\"", crc);
+}
+static void
+record_bool(core_record *r, const char *key, ee_u8 value)
+{
+    if (record_key(r, key))
+        record_printf(r, value ? "true" : "false");
+}
+/* Function: record_null
+        A field without a value, null in JSON and empty in CSV.
+*/
+static void
+record_null(core_record *r, const char *key)
+{
+    if (record_key(r, key) && !r->csv)
+        record_printf(r, "null");
+}
+/* Function: record_str
+        A quoted string. Quotes are escaped, doubled in CSV, and control
+   characters such as the line breaks in MEM_LOCATION are escaped in JSON and
+   become blanks in CSV.
+*/
+static void
+record_str(core_record *r, const char *key, const char *s)
+{
+    if (!record_key(r, key))
+        return;
+    record_printf(r, "\"");
+    for (; *s; s++)
+    {
+        if (*s == '"')
+            record_printf(r, r->csv ? "\"\"" : "\\\"");
+        else if ((*s == '\\') && !r->csv)
+            record_printf(r, "\\\\");
+        else if (((unsigned char)*s < ' ') && r->csv)
+            record_printf(r, " ");
+        else if ((unsigned char)*s < ' ')
+            record_printf(r, "\\u%04x", *s);
+        else
+            record_printf(r, "%c", *s);
+    }
+    record_printf(r, "\"");
+}
+#if LATENCY_HISTOGRAM
+static void
+record_latency(core_record *r, core_latency *lat)
+{
+    record_u64(r, "latency p50 ns", latency_percentile(lat, 500));
+    record_u64(r, "latency p90 ns", latency_percentile(lat, 900));
+    record_u64(r, "latency p99 ns", latency_percentile(lat, 990));
+    record_u64(r, "latency p999 ns", latency_percentile(lat, 999));
+    record_u64(r, "latency max ns", lat->max);
+}
+#endif
+#if KERNEL_PROFILE
+static void
+record_profile(core_record *r, core_profile *p)
+{
+    char   key[32];
+    ee_u32 k;
+    for (k = 0; k < NUM_KERNELS; k++)
+    {
+        snprintf(key, sizeof(key), "%s calls", kernel_name[k]);
+        record_u64(r, key, p->calls[k]);
+        if (k == KERNEL_CALC_HIT)
+            continue;
+        snprintf(key, sizeof(key), "%s ns", kernel_name[k]);
+        record_u64(r, key, p->ns[k]);
+    }
+}
+#endif
+#if PERF_COUNTERS
+/* Function: record_counters
+        The performance counters of a context, null when unavailable, and
+   the rates derived from them as in <report_rates>.
+*/
+static void
+record_counters(core_record *r, core_counters *c, ee_u64 iterations)
+{
+    ee_u32 k;
+#if HAS_FLOAT
+    ee_u32 needed = (1 << COUNTER_CYCLES) | (1 << COUNTER_INSTRUCTIONS);
+#endif
+    for (k = 0; k < NUM_COUNTERS; k++)
+        if (c->valid & (1 << k))
+            record_u64(r, counter_name[k], c->value[k]);
+        else
+            record_null(r, counter_name[k]);
+#if HAS_FLOAT
+    if (((c->valid & needed) == needed) && (c->value[COUNTER_CYCLES] > 0))
+    {
+        record_real(r,
+                    "ipc",
+                    (double)c->value[COUNTER_INSTRUCTIONS]
+                        / c->value[COUNTER_CYCLES]);
+        record_real(r,
+                    "coremark per ghz",
+                    iterations * 1e9 / c->value[COUNTER_CYCLES]);
+    }
+    else
+    {
+        record_null(r, "ipc");
+        record_null(r, "coremark per ghz");
+    }
+#endif
+}
+#endif
+/* Function: record_context
+        The fields of one context. Its CRCs and iterations are those of the
+   last trial, and so are its ticks.
+*/
+static void
+record_context(core_record *r, core_results *res, ee_u32 context)
+{
+#if (MULTITHREAD > 1)
+    CORE_TICKS ticks = res->stop_ticks - res->start_ticks;
+#else
+    CORE_TICKS ticks = trials.ticks[trials.num - 1];
+#endif
+    record_u64(r, "context", context);
+    record_crc(r, "crclist", res->crclist);
+    record_crc(r, "crcmatrix", res->crcmatrix);
+    record_crc(r, "crcstate", res->crcstate);
+    record_crc(r, "crcfinal", res->crc);
+    record_u64(r, "iterations", res->iterations);
+    record_u64(r, "ticks", ticks);
+    if (time_in_secs(ticks) > 0)
+        record_real(r,
+                    "iterations per sec",
+                    res->iterations / time_in_secs(ticks));
+    else
+        record_null(r, "iterations per sec");
+#if (MULTITHREAD > 1)
+    record_u64(r, "start ticks", res->start_ticks);
+    record_u64(r, "stop ticks", res->stop_ticks);
+    record_s32(r, "cpu", res->cpu);
+    record_s32(r, "memory node", res->mem_node);
+#endif
+#if LATENCY_HISTOGRAM
+    record_latency(r, &res->latency);
+#endif
+#if KERNEL_PROFILE
+    record_profile(r, &res->profile);
+#endif
+#if PERF_COUNTERS
+    record_counters(r, &res->counters, res->iterations);
+#endif
+}
+/* Function: record_run
+        The fields of the whole run: the inputs, the validation status, the
+   median trial, the trial statistics and how the benchmark was built and
+   run.
+*/
+static void
+record_run(core_record  *r,
+           core_results *results,
+           CORE_TICKS    total_time,
+           ee_u64        total_iterations,
+           ee_u16        seedcrc,
+           ee_s16        known_id,
+           ee_s16        total_errors,
+           ee_u64        warmup_iterations,
+           CORE_TICKS    warmup_ticks)
+{
+#if HAS_FLOAT
+    secs_ret mean, sd, half;
+#endif
+    record_s32(r, "seed1", results[0].seed1);
+    record_s32(r, "seed2", results[0].seed2);
+    record_s32(r, "seed3", results[0].seed3);
+    record_u64(r, "size", results[0].size);
+#if (MEM_METHOD == MEM_MALLOC)
+    record_u64(r, "list footprint", default_list_footprint);
+    record_u64(r, "list items", default_list_items);
+#endif
+    record_crc(r, "seedcrc", seedcrc);
+    if (known_id >= 0)
+        record_str(r, "run", known_run_name[known_id]);
+    else
+        record_null(r, "run");
+    record_str(r,
+               "validation",
+               (total_errors == 0)  ? "validated"
+               : (total_errors > 0) ? "errors"
+                                    : "unknown seeds");
+    record_bool(r, "valid", total_errors == 0);
+    record_u64(r, "errors", (total_errors > 0) ? total_errors : 0);
+    record_u64(r, "total ticks", total_time);
+    record_real(r, "total secs", time_in_secs(total_time));
+    record_u64(r, "total iterations", total_iterations);
+    if (time_in_secs(total_time) > 0)
+        record_real(r,
+                    "total iterations per sec",
+                    total_iterations / time_in_secs(total_time));
+    else
+        record_null(r, "total iterations per sec");
+#if CALIBRATION_WARMUP
+    record_u64(r, "warmup iterations", warmup_iterations);
+    record_real(r, "warmup secs", time_in_secs(warmup_ticks));
+#else
+    (void)warmup_iterations;
+    (void)warmup_ticks;
+#endif
+    record_u64(r, "trials", trials.num);
+    record_u64(r,
+               "trials rejected",
+               trials.num - (trials.last_kept - trials.first_kept + 1));
+#if HAS_FLOAT
+    trials_stats(&trials, &mean, &sd, &half);
+    record_real(r,
+                "trials minimum",
+                trial_rate(&trials, trials.order[trials.first_kept]));
+    record_real(r, "trials mean", mean);
+    record_real(r, "trials std deviation", sd);
+    record_real(r, "trials confidence low", mean - half);
+    record_real(r, "trials confidence high", mean + half);
+#endif
+    record_str(r, "compiler version", COMPILER_VERSION);
+    record_str(r, "compiler flags", COMPILER_FLAGS);
+    record_str(r, "memory location", MEM_LOCATION);
+#if (MULTITHREAD > 1)
+    record_str(r, "parallel method", PARALLEL_METHOD);
+    record_u64(r, "duration secs", default_duration);
 #endif
+    record_u64(r, "contexts", default_num_contexts);
+}
+/* Function: report_record
+        Report the results as one JSON object, or as a CSV header line and
+   one row per context that repeats the fields of the whole run. Only the
+   JSON object lists the trials, the steps of the sweeps and the cpus of the
+   scan, which do not fit the rows of the contexts.
 
-#if (MEM_METHOD == MEM_STATIC)
-ee_u8 static_memblk[TOTAL_DATA_SIZE];
+        The record is formatted into one buffer once all trials are done and
+   printed with a single call, so that reporting never runs while contexts
+   are timed and a record is either complete or not printed at all.
+*/
+static void
+report_record(core_results *results,
+              CORE_TICKS    total_time,
+              ee_u64        total_iterations,
+              ee_u16        seedcrc,
+              ee_s16        known_id,
+              ee_s16        total_errors,
+              ee_u64        warmup_iterations,
+              CORE_TICKS    warmup_ticks)
+{
+    core_record r;
+    ee_u32      i;
+#if (MULTITHREAD > 1)
+    /* a cpu of the scan takes no more room than a context */
+    r.size = RECORD_SIZE(default_num_contexts + default_num_scan_cpus);
+    r.buf  = (char *)portable_malloc(r.size);
+    if (r.buf == NULL)
+    {
+        ee_printf("ERROR! Cannot allocate the result record!\n");
+        return;
+    }
+#else
+    static char buf[RECORD_SIZE(1)];
+    r.buf  = buf;
+    r.size = RECORD_SIZE(1);
+#endif
+    r.len  = 0;
+    r.csv  = (default_output_format == OUTPUT_CSV);
+    if (r.csv)
+    {
+        r.header = 1;
+        r.first  = 1;
+        record_context(&r, &results[0], 0);
+        record_run(&r,
+                   results,
+                   total_time,
+                   total_iterations,
+                   seedcrc,
+                   known_id,
+                   total_errors,
+                   warmup_iterations,
+                   warmup_ticks);
+        record_printf(&r, "\n");
+        r.header = 0;
+        for (i = 0; i < default_num_contexts; i++)
+        {
+            r.first = 1;
+            record_context(&r, &results[i], i);
+            record_run(&r,
+                       results,
+                       total_time,
+                       total_iterations,
+                       seedcrc,
+                       known_id,
+                       total_errors,
+                       warmup_iterations,
+                       warmup_ticks);
+            record_printf(&r, "\n");
+        }
+    }
+    else
+    {
+        r.header = 0;
+        r.first  = 1;
+        record_printf(&r, "{");
+        record_run(&r,
+                   results,
+                   total_time,
+                   total_iterations,
+                   seedcrc,
+                   known_id,
+                   total_errors,
+                   warmup_iterations,
+                   warmup_ticks);
+        record_printf(&r, ",\"trial\":[");
+        for (i = 0; i < trials.num; i++)
+        {
+            record_printf(&r, (i > 0) ? ",{" : "{");
+            r.first = 1;
+            record_u64(&r, "ticks", trials.ticks[i]);
+            record_u64(&r, "iterations", trials.iterations[i]);
+#if HAS_FLOAT
+            record_real(&r, "iterations per sec", trial_rate(&trials, i));
+#endif
+            record_bool(&r, "rejected", trial_rejected(&trials, i));
+            record_printf(&r, "}");
+        }
+        record_printf(&r, "],\"context\":[");
+        for (i = 0; i < default_num_contexts; i++)
+        {
+            record_printf(&r, (i > 0) ? ",{" : "{");
+            r.first = 1;
+            record_context(&r, &results[i], i);
+            record_printf(&r, "}");
+        }
+        record_printf(&r, "]");
+#if (MULTITHREAD > 1)
+        if (default_num_sweep > 1)
+        {
+            record_printf(&r, ",\"sweep\":[");
+            for (i = 0; i < default_num_sweep; i++)
+            {
+                record_printf(&r, (i > 0) ? ",{" : "{");
+                r.first = 1;
+                record_u64(&r, "contexts", default_sweep[i]);
+                record_u64(&r, "ticks", sweep_ticks[i]);
+                record_u64(&r, "iterations", sweep_iterations[i]);
+#if HAS_FLOAT
+                record_real(&r, "iterations per sec", sweep_rate(i));
+                record_real(&r,
+                            "iterations per sec per context",
+                            sweep_rate(i) / default_sweep[i]);
+                record_real(&r, "efficiency", sweep_efficiency(i));
+#endif
+                record_printf(&r, "}");
+            }
+            record_printf(&r, "]");
+        }
+        if (default_scan != SCAN_NONE)
+        {
+            record_printf(&r, ",\"cpu_scan\":[");
+            for (i = 0; i < default_num_scan_cpus; i++)
+            {
+                core_scan_cpu *c = &scan_cpus[i];
+                record_printf(&r, (i > 0) ? ",{" : "{");
+                r.first = 1;
+                if (c->cpu >= 0)
+                    record_s32(&r, "cpu", c->cpu);
+                else
+                    record_null(&r, "cpu");
+                record_u64(&r, "ticks", c->ticks);
+                record_u64(&r, "iterations", c->iterations);
+#if HAS_FLOAT
+                record_real(&r, "iterations per sec", scan_rate(i));
+                record_real(&r, "deviation", scan_deviation(i));
+                record_bool(&r, "outlier", scan_outlier(i));
+#endif
+                record_bool(&r, "valid", c->valid);
+                record_printf(&r, "}");
+            }
+            record_printf(&r, "]");
+        }
+#endif
+#if (MEM_METHOD == MEM_MALLOC)
+        if (default_num_size_sweep > 0)
+        {
+            record_printf(&r, ",\"size_sweep\":[");
+            for (i = 0; i < default_num_size_sweep; i++)
+            {
+                core_size_step *s = &size_steps[i];
+                record_printf(&r, (i > 0) ? ",{" : "{");
+                r.first = 1;
+                record_u64(&r, "size", s->size);
+                record_u64(&r, "ticks", s->ticks);
+                record_u64(&r, "iterations", s->iterations);
+#if HAS_FLOAT
+                if (time_in_secs(s->ticks) > 0)
+                    record_real(&r,
+                                "iterations per sec",
+                                s->iterations / time_in_secs(s->ticks));
+                else
+                    record_null(&r, "iterations per sec");
+#endif
+                record_crc(&r, "crclist", s->crclist);
+                record_crc(&r, "crcmatrix", s->crcmatrix);
+                record_crc(&r, "crcstate", s->crcstate);
+                if (s->valid < 0)
+                    record_null(&r, "valid");
+                else
+                    record_bool(&r, "valid", s->valid);
+                record_printf(&r, "}");
+            }
+            record_printf(&r, "]");
+        }
+#endif
+        record_printf(&r, "}\n");
+    }
+    if (r.len >= r.size)
+        ee_printf("ERROR! Result record needs more than %lu bytes!\n",
+                  (long unsigned)r.size);
+    else
+        ee_printf("%s", r.buf);
+#if (MULTITHREAD > 1)
+    portable_free(r.buf);
+#endif
+}
 #endif
-char *mem_name[3] = { "Static", "Heap", "Stack" };
 /* Function: main
         Main entry routine for the benchmark.
         This function is responsible for the following steps:
@@ -100,7 +1965,7 @@ char *mem_name[3] = { "Static", "Heap", "Stack" };
    identical 3 - third seed  : Any value, should be at least an order of
    magnitude less then the input size, but bigger then 32. 4 - Iterations  :
    Special, if set to 0, iterations will be automatically determined such that
-   the benchmark will run between 10 to 100 secs
+   the benchmark will run for about <CALIBRATION_SECS>, see <calibrate>.
 
 */
 
@@ -115,16 +1980,53 @@ MAIN_RETURN_TYPE
 main(int argc, char *argv[])
 {
 #endif
-    ee_u16       i, j = 0, num_algorithms = 0;
-    ee_s16       known_id = -1, total_errors = 0;
-    ee_u16       seedcrc = 0;
-    CORE_TICKS   total_time;
-    core_results results[MULTITHREAD];
-#if (MEM_METHOD == MEM_STACK)
+    ee_u32     i, trial, num_algorithms = 0;
+    ee_s16     known_id = -1, total_errors = 0, trial_errors = 0, run_errors;
+    ee_u16     seedcrc = 0, known_list = 0, known_matrix = 0, known_state = 0;
+    CORE_TICKS total_time;
+    ee_u64     total_iterations = 0, warmup_iterations = 0;
+    CORE_TICKS warmup_ticks = 0;
+#if (MULTITHREAD > 1)
+    core_portable port;
+    core_results *results;
+#else
+    core_results results[1];
+#endif
+#if (MEM_METHOD == MEM_STACK) && !((MULTITHREAD > 1) && CONTEXT_STACK)
     ee_u8 stack_memblock[TOTAL_DATA_SIZE * MULTITHREAD];
 #endif
     /* first call any initializations needed */
+#if (MULTITHREAD > 1)
+    portable_init(&port, &argc, argv);
+#if (MEM_METHOD == MEM_STACK) && !CONTEXT_STACK
+    if (default_num_contexts > MULTITHREAD)
+    {
+        ee_printf("Stack memory only holds %d contexts, using %d\n",
+                  MULTITHREAD,
+                  MULTITHREAD);
+        default_num_contexts = MULTITHREAD;
+    }
+#endif
+    /* The number of contexts is only known once the port has parsed its
+     * arguments, so the context array is sized at run time. */
+    results = (core_results *)portable_malloc(default_num_contexts
+                                              * sizeof(core_results));
+    if (results == NULL)
+    {
+        ee_printf("ERROR! Cannot allocate %lu contexts!\n",
+                  (long unsigned)default_num_contexts);
+        return MAIN_RETURN_VAL;
+    }
+#else
     portable_init(&(results[0].port), &argc, argv);
+#endif
+    if (default_num_trials > MAX_TRIALS)
+    {
+        ee_printf(
+            "Only %d trials are kept, using %d\n", MAX_TRIALS, MAX_TRIALS);
+        default_num_trials = MAX_TRIALS;
+    }
+    trials.num = (default_num_trials > 0) ? default_num_trials : 1;
     /* First some checks to make sure benchmark will run ok */
     if (sizeof(struct list_head_s) > 128)
     {
@@ -166,14 +2068,15 @@ main(int argc, char *argv[])
 #error "Cannot use a static data area with multiple contexts!"
 #endif
 #elif (MEM_METHOD == MEM_MALLOC)
-    for (i = 0; i < MULTITHREAD; i++)
+    for (i = 0; i < default_num_contexts; i++)
     {
         ee_s32 malloc_override = get_seed(7);
         if (malloc_override != 0)
             results[i].size = malloc_override;
         else
             results[i].size = TOTAL_DATA_SIZE;
-        results[i].memblock[0] = portable_malloc(results[i].size);
+        results[i].memblock[0] = NULL; /* see core_init_context */
+        results[i].list_block  = NULL;
         results[i].seed1       = results[0].seed1;
         results[i].seed2       = results[0].seed2;
         results[i].seed3       = results[0].seed3;
@@ -181,9 +2084,13 @@ main(int argc, char *argv[])
         results[i].execs       = results[0].execs;
     }
 #elif (MEM_METHOD == MEM_STACK)
-for (i = 0; i < MULTITHREAD; i++)
+for (i = 0; i < default_num_contexts; i++)
 {
+#if (MULTITHREAD > 1) && CONTEXT_STACK
+    results[i].memblock[0] = NULL; /* see core_init_context */
+#else
     results[i].memblock[0] = stack_memblock + i * TOTAL_DATA_SIZE;
+#endif
     results[i].size        = TOTAL_DATA_SIZE;
     results[i].seed1       = results[0].seed1;
     results[i].seed2       = results[0].seed2;
@@ -201,88 +2108,67 @@ for (i = 0; i < MULTITHREAD; i++)
         if ((1 << (ee_u32)i) & results[0].execs)
             num_algorithms++;
     }
-    for (i = 0; i < MULTITHREAD; i++)
-        results[i].size = results[i].size / num_algorithms;
-    /* Assign pointers */
-    for (i = 0; i < NUM_ALGORITHMS; i++)
+    for (i = 0; i < default_num_contexts; i++)
     {
-        ee_u32 ctx;
-        if ((1 << (ee_u32)i) & results[0].execs)
-        {
-            for (ctx = 0; ctx < MULTITHREAD; ctx++)
-                results[ctx].memblock[i + 1]
-                    = (char *)(results[ctx].memblock[0]) + results[0].size * j;
-            j++;
-        }
+        results[i].size     = results[i].size / num_algorithms;
+        results[i].cpu      = -1;
+        results[i].mem_node = -1;
+#if (MULTITHREAD > 1)
+        /* until started, every context has the state <portable_init> set */
+        results[i].port = port;
+#endif
     }
-    /* call inits */
-    for (i = 0; i < MULTITHREAD; i++)
+#if (MULTITHREAD > 1)
+    /* each context initializes its own data once started, so that it is
+     * first touched where the context runs, see core_start_parallel */
+#else
+    if (core_init_context(&results[0]))
+        return MAIN_RETURN_VAL;
+#endif
+
+#if (MEM_METHOD == MEM_MALLOC)
+    if (default_num_size_sweep > 0)
     {
-        if (results[i].execs & ID_LIST)
-        {
-            results[i].list = core_list_init(
-                results[0].size, results[i].memblock[1], results[i].seed1);
-        }
-        if (results[i].execs & ID_MATRIX)
-        {
-            core_init_matrix(results[0].size,
-                             results[i].memblock[2],
-                             (ee_s32)results[i].seed1
-                                 | (((ee_s32)results[i].seed2) << 16),
-                             &(results[i].mat));
-        }
-        if (results[i].execs & ID_STATE)
-        {
-            core_init_state(
-                results[0].size, results[i].seed1, results[i].memblock[3]);
-        }
+        ee_s16 sweep_errors
+            = size_sweep(results, results[0].size, num_algorithms);
+        if (sweep_errors < 0)
+            return MAIN_RETURN_VAL;
+        trial_errors += sweep_errors;
     }
-
+#endif
     /* automatically determine number of iterations if not set */
-    if (results[0].iterations == 0)
-    {
-        secs_ret secs_passed = 0;
-        ee_u32   divisor;
-        results[0].iterations = 1;
-        while (secs_passed < (secs_ret)1)
-        {
-            results[0].iterations *= 10;
-            start_time();
-            iterate(&results[0]);
-            stop_time();
-            secs_passed = time_in_secs(get_time());
-        }
-        /* now we know it executes for at least 1 sec, set actual run time at
-         * about 10 secs */
-        divisor = (ee_u32)secs_passed;
-        if (divisor == 0) /* some machines cast float to int as 0 since this
-                             conversion is not defined by ANSI, but we know at
-                             least one second passed */
-            divisor = 1;
-        results[0].iterations *= 1 + 10 / divisor;
-    }
-    /* perform actual benchmark */
-    start_time();
+    if (calibrate_iterations(
+            results, CALIBRATION_SECS, &warmup_iterations, &warmup_ticks))
+        return MAIN_RETURN_VAL;
+    /* perform actual benchmark, once per trial on the same data */
 #if (MULTITHREAD > 1)
-    if (default_num_contexts > MULTITHREAD)
-    {
-        default_num_contexts = MULTITHREAD;
-    }
-    for (i = 0; i < default_num_contexts; i++)
+    if (default_num_sweep > 1)
     {
-        results[i].iterations = results[0].iterations;
-        results[i].execs      = results[0].execs;
-        core_start_parallel(&results[i]);
+        ee_s16 sweep_errors = sweep_contexts(results);
+        if (sweep_errors < 0)
+            return MAIN_RETURN_VAL;
+        trial_errors += sweep_errors;
     }
-    for (i = 0; i < default_num_contexts; i++)
+    if ((default_scan != SCAN_NONE) && scan_run(results))
+        return MAIN_RETURN_VAL;
+#endif
+    run_errors = run_trials(results);
+    if (run_errors < 0)
+        return MAIN_RETURN_VAL;
+    trial_errors += run_errors;
+    /* report the median trial */
+    trial            = trials_median(&trials);
+    total_time       = trials.ticks[trial];
+    total_iterations = trials.iterations[trial];
+#if (MULTITHREAD > 1)
+    if (default_num_sweep > 1)
     {
-        core_stop_parallel(&results[i]);
+        sweep_ticks[default_num_sweep - 1]      = total_time;
+        sweep_iterations[default_num_sweep - 1] = total_iterations;
     }
-#else
-    iterate(&results[0]);
+    if (default_scan != SCAN_NONE)
+        trial_errors += scan_validate(results);
 #endif
-    stop_time();
-    total_time = get_time();
     /* get a function of the input to report */
     seedcrc = crc16(results[0].seed1, seedcrc);
     seedcrc = crc16(results[0].seed2, seedcrc);
@@ -293,150 +2179,230 @@ for (i = 0; i < MULTITHREAD; i++)
     {                /* test known output for common seeds */
         case 0x8a02: /* seed1=0, seed2=0, seed3=0x66, size 2000 per algorithm */
             known_id = 0;
-            ee_printf("6k performance run parameters for coremark.\n");
             break;
         case 0x7b05: /*  seed1=0x3415, seed2=0x3415, seed3=0x66, size 2000 per
                         algorithm */
             known_id = 1;
-            ee_printf("6k validation run parameters for coremark.\n");
             break;
         case 0x4eaf: /* seed1=0x8, seed2=0x8, seed3=0x8, size 400 per algorithm
                       */
             known_id = 2;
-            ee_printf("Profile generation run parameters for coremark.\n");
             break;
         case 0xe9f5: /* seed1=0, seed2=0, seed3=0x66, size 666 per algorithm */
             known_id = 3;
-            ee_printf("2K performance run parameters for coremark.\n");
             break;
         case 0x18f2: /*  seed1=0x3415, seed2=0x3415, seed3=0x66, size 666 per
                         algorithm */
             known_id = 4;
-            ee_printf("2K validation run parameters for coremark.\n");
             break;
         default:
             total_errors = -1;
             break;
     }
+    if ((known_id >= 0)
+        && !known_crcs(
+            &results[0], known_id, &known_list, &known_matrix, &known_state))
+    {
+        known_id     = -1;
+        total_errors = -1;
+    }
+    if ((known_id >= 0) && (default_output_format == OUTPUT_TEXT))
+        ee_printf("%s run parameters for coremark.\n",
+                  known_run_name[known_id]);
     if (known_id >= 0)
     {
         for (i = 0; i < default_num_contexts; i++)
         {
             results[i].err = 0;
             if ((results[i].execs & ID_LIST)
-                && (results[i].crclist != list_known_crc[known_id]))
+                && (results[i].crclist != known_list))
             {
-                ee_printf("[%u]ERROR! list crc 0x%04x - should be 0x%04x\n",
-                          i,
-                          results[i].crclist,
-                          list_known_crc[known_id]);
+                if (default_output_format == OUTPUT_TEXT)
+                    ee_printf(
+                        "[%u]ERROR! list crc 0x%04x - should be 0x%04x\n",
+                        i,
+                        results[i].crclist,
+                        known_list);
                 results[i].err++;
             }
             if ((results[i].execs & ID_MATRIX)
-                && (results[i].crcmatrix != matrix_known_crc[known_id]))
+                && (results[i].crcmatrix != known_matrix))
             {
-                ee_printf("[%u]ERROR! matrix crc 0x%04x - should be 0x%04x\n",
-                          i,
-                          results[i].crcmatrix,
-                          matrix_known_crc[known_id]);
+                if (default_output_format == OUTPUT_TEXT)
+                    ee_printf(
+                        "[%u]ERROR! matrix crc 0x%04x - should be 0x%04x\n",
+                        i,
+                        results[i].crcmatrix,
+                        known_matrix);
                 results[i].err++;
             }
             if ((results[i].execs & ID_STATE)
-                && (results[i].crcstate != state_known_crc[known_id]))
+                && (results[i].crcstate != known_state))
             {
-                ee_printf("[%u]ERROR! state crc 0x%04x - should be 0x%04x\n",
-                          i,
-                          results[i].crcstate,
-                          state_known_crc[known_id]);
+                if (default_output_format == OUTPUT_TEXT)
+                    ee_printf(
+                        "[%u]ERROR! state crc 0x%04x - should be 0x%04x\n",
+                        i,
+                        results[i].crcstate,
+                        known_state);
                 results[i].err++;
             }
             total_errors += results[i].err;
         }
     }
     total_errors += check_data_types();
-    /* and report results */
-    ee_printf("CoreMark Size    : %lu\n", (long unsigned)results[0].size);
-    ee_printf("Total ticks      : %lu\n", (long unsigned)total_time);
+    total_errors += trial_errors;
+    if (time_in_secs(total_time) < MIN_RUN_SECS)
+        total_errors++;
+#if OUTPUT_RECORD
+    if (default_output_format != OUTPUT_TEXT)
+        report_record(results,
+                      total_time,
+                      total_iterations,
+                      seedcrc,
+                      known_id,
+                      total_errors,
+                      warmup_iterations,
+                      warmup_ticks);
+    else
+#endif
+    {
+        /* and report results */
+        ee_printf("CoreMark Size    : %lu\n", (long unsigned)results[0].size);
+        ee_printf("Total ticks      : %lu\n", (long unsigned)total_time);
 #if HAS_FLOAT
-    ee_printf("Total time (secs): %f\n", time_in_secs(total_time));
-    if (time_in_secs(total_time) > 0)
-        ee_printf("Iterations/Sec   : %f\n",
-                  default_num_contexts * results[0].iterations
-                      / time_in_secs(total_time));
+        ee_printf("Total time (secs): %f\n", time_in_secs(total_time));
+        if (time_in_secs(total_time) > 0)
+            ee_printf("Iterations/Sec   : %f\n",
+                      total_iterations / time_in_secs(total_time));
 #else
-    ee_printf("Total time (secs): %d\n", time_in_secs(total_time));
-    if (time_in_secs(total_time) > 0)
-        ee_printf("Iterations/Sec   : %d\n",
-                  default_num_contexts * results[0].iterations
-                      / time_in_secs(total_time));
+        ee_printf("Total time (secs): %d\n", time_in_secs(total_time));
+        if (time_in_secs(total_time) > 0)
+            ee_printf("Iterations/Sec   : %d\n",
+                      (ee_u32)(total_iterations / time_in_secs(total_time)));
 #endif
-    if (time_in_secs(total_time) < 10)
-    {
-        ee_printf(
-            "ERROR! Must execute for at least 10 secs for a valid result!\n");
-        total_errors++;
-    }
+        if (time_in_secs(total_time) < MIN_RUN_SECS)
+            ee_printf(
+                "ERROR! Must execute for at least %d secs for a valid "
+                "result!\n",
+                MIN_RUN_SECS);
 
-    ee_printf("Iterations       : %lu\n",
-              (long unsigned)default_num_contexts * results[0].iterations);
-    ee_printf("Compiler version : %s\n", COMPILER_VERSION);
-    ee_printf("Compiler flags   : %s\n", COMPILER_FLAGS);
+        ee_printf("Iterations       : %lu\n",
+                  (long unsigned)total_iterations);
+#if CALIBRATION_WARMUP
+        ee_printf("Warmup iterations: %lu\n",
+                  (long unsigned)warmup_iterations);
+#if HAS_FLOAT
+        ee_printf("Warmup secs      : %f\n", time_in_secs(warmup_ticks));
+#else
+        ee_printf("Warmup secs      : %d\n", time_in_secs(warmup_ticks));
+#endif
+#endif
+        ee_printf("Compiler version : %s\n", COMPILER_VERSION);
+        ee_printf("Compiler flags   : %s\n", COMPILER_FLAGS);
 #if (MULTITHREAD > 1)
-    ee_printf("Parallel %s : %d\n", PARALLEL_METHOD, default_num_contexts);
+        ee_printf(
+            "Parallel %s : %d\n", PARALLEL_METHOD, default_num_contexts);
+        if (default_duration > 0)
+            ee_printf("Fixed duration   : %lu secs\n",
+                      (long unsigned)default_duration);
+        report_contexts(results, default_num_contexts);
 #endif
-    ee_printf("Memory location  : %s\n", MEM_LOCATION);
-    /* output for verification */
-    ee_printf("seedcrc          : 0x%04x\n", seedcrc);
-    if (results[0].execs & ID_LIST)
-        for (i = 0; i < default_num_contexts; i++)
-            ee_printf("[%d]crclist       : 0x%04x\n", i, results[i].crclist);
-    if (results[0].execs & ID_MATRIX)
-        for (i = 0; i < default_num_contexts; i++)
-            ee_printf("[%d]crcmatrix     : 0x%04x\n", i, results[i].crcmatrix);
-    if (results[0].execs & ID_STATE)
+        if (trials.num > 1)
+            report_trials(&trials);
+#if (MULTITHREAD > 1)
+        if (default_num_sweep > 1)
+            report_sweep();
+        if (default_scan != SCAN_NONE)
+            report_scan();
+#endif
+#if (MEM_METHOD == MEM_MALLOC)
+        if (default_num_size_sweep > 0)
+            report_size_sweep();
+#endif
+#if LATENCY_HISTOGRAM
+        report_latency(results, default_num_contexts);
+#endif
+#if KERNEL_PROFILE
+        report_profile(results, default_num_contexts);
+#endif
+#if PERF_COUNTERS
+        report_counters(results, default_num_contexts);
+#endif
+#if (MEM_METHOD == MEM_MALLOC)
+        if (default_list_footprint > 0)
+            ee_printf("List footprint   : %lu bytes, scattered\n",
+                      (long unsigned)default_list_footprint);
+        if (default_list_items > 0)
+            ee_printf("List items       : %lu\n",
+                      (long unsigned)default_list_items);
+#endif
+        ee_printf("Memory location  : %s\n", MEM_LOCATION);
+        /* output for verification */
+        ee_printf("seedcrc          : 0x%04x\n", seedcrc);
+        if (results[0].execs & ID_LIST)
+            for (i = 0; i < default_num_contexts; i++)
+                ee_printf(
+                    "[%d]crclist       : 0x%04x\n", i, results[i].crclist);
+        if (results[0].execs & ID_MATRIX)
+            for (i = 0; i < default_num_contexts; i++)
+                ee_printf(
+                    "[%d]crcmatrix     : 0x%04x\n", i, results[i].crcmatrix);
+        if (results[0].execs & ID_STATE)
+            for (i = 0; i < default_num_contexts; i++)
+                ee_printf(
+                    "[%d]crcstate      : 0x%04x\n", i, results[i].crcstate);
         for (i = 0; i < default_num_contexts; i++)
-            ee_printf("[%d]crcstate      : 0x%04x\n", i, results[i].crcstate);
-    for (i = 0; i < default_num_contexts; i++)
-        ee_printf("[%d]crcfinal      : 0x%04x\n", i, results[i].crc);
-    if (total_errors == 0)
-    {
-        ee_printf(
-            "Correct operation validated. See README.md for run and reporting "
-            "rules.\n");
-#if HAS_FLOAT
-        if (known_id == 3)
+            ee_printf("[%d]crcfinal      : 0x%04x\n", i, results[i].crc);
+        if (total_errors == 0)
         {
-            ee_printf("CoreMark 1.0 : %f / %s %s",
-                      default_num_contexts * results[0].iterations
-                          / time_in_secs(total_time),
-                      COMPILER_VERSION,
-                      COMPILER_FLAGS);
+            ee_printf(
+                "Correct operation validated. See README.md for run and "
+                "reporting rules.\n");
+#if HAS_FLOAT && !LIST_WIDE
+            /* the wide list is a different workload, not a CoreMark score */
+            if (known_id == 3)
+            {
+                ee_printf("CoreMark 1.0 : %f / %s %s",
+                          total_iterations / time_in_secs(total_time),
+                          COMPILER_VERSION,
+                          COMPILER_FLAGS);
 #if defined(MEM_LOCATION) && !defined(MEM_LOCATION_UNSPEC)
-            ee_printf(" / %s", MEM_LOCATION);
+                ee_printf(" / %s", MEM_LOCATION);
 #else
-            ee_printf(" / %s", mem_name[MEM_METHOD]);
+                ee_printf(" / %s", mem_name[MEM_METHOD]);
 #endif
 
 #if (MULTITHREAD > 1)
-            ee_printf(" / %d:%s", default_num_contexts, PARALLEL_METHOD);
+                ee_printf(" / %d:%s", default_num_contexts, PARALLEL_METHOD);
 #endif
-            ee_printf("\n");
-        }
+                ee_printf("\n");
+            }
 #endif
+        }
+        if (total_errors > 0)
+            ee_printf("Errors detected\n");
+        if (total_errors < 0)
+            ee_printf(
+                "Cannot validate operation for these seed values, please "
+                "compare with results on a known platform.\n");
     }
-    if (total_errors > 0)
-        ee_printf("Errors detected\n");
-    if (total_errors < 0)
-        ee_printf(
-            "Cannot validate operation for these seed values, please compare "
-            "with results on a known platform.\n");
 
 #if (MEM_METHOD == MEM_MALLOC)
-    for (i = 0; i < MULTITHREAD; i++)
-        portable_free(results[i].memblock[0]);
+    for (i = 0; i < default_num_contexts; i++)
+    {
+        portable_memblock_free(results[i].memblock[0]);
+        portable_memblock_free(results[i].list_block);
+    }
 #endif
     /* And last call any target specific code for finalizing */
+#if (MULTITHREAD > 1)
+    portable_free(scan_cpus);
+    portable_free(results);
+    portable_fini(&port);
+#else
     portable_fini(&(results[0].port));
+#endif
 
     return MAIN_RETURN_VAL;
 }
@@ -35,7 +35,11 @@ zero). NxN Matrix C - used for the result.
         The actual values for A and B must be derived based on input that is not
 available at compile time.
 */
-ee_s16 matrix_test(ee_u32 N, MATRES *C, MATDAT *A, MATDAT *B, MATDAT val);
+ee_s16 matrix_test(ee_u32 N,
+                   MATRES *C,
+                   MATDAT *A,
+                   MATDAT *B,
+                   MATDAT val PROFILE_PARAM);
 ee_s16 matrix_sum(ee_u32 N, MATRES *C, MATDAT clipval);
 void   matrix_mul_const(ee_u32 N, MATRES *C, MATDAT *A, MATDAT val);
 void   matrix_mul_vect(ee_u32 N, MATRES *C, MATDAT *A, MATDAT *B);
@@ -89,7 +93,7 @@ printmatC(MATRES *C, ee_u32 N, char *name)
         changing the matrix values slightly by a constant amount each time.
 */
 ee_u16
-core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc)
+core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc PROFILE_PARAM)
 {
     ee_u32  N   = p->N;
     MATRES *C   = p->C;
@@ -97,7 +101,7 @@ core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc)
     MATDAT *B   = p->B;
     MATDAT  val = (MATDAT)seed;
 
-    crc = crc16(matrix_test(N, C, A, B, val), crc);
+    crc = crc16(matrix_test(N, C, A, B, val PROFILE_ARG(prof)), crc);
 
     return crc;
 }
@@ -127,37 +131,62 @@ core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc)
         After the last step, matrix A is back to original contents.
 */
 ee_s16
-matrix_test(ee_u32 N, MATRES *C, MATDAT *A, MATDAT *B, MATDAT val)
+matrix_test(ee_u32 N,
+            MATRES *C,
+            MATDAT *A,
+            MATDAT *B,
+            MATDAT val PROFILE_PARAM)
 {
     ee_u16 crc     = 0;
     MATDAT clipval = matrix_big(val);
+    PROFILE_VAR(begin);
 
+    PROFILE_BEGIN(begin);
     matrix_add_const(N, A, val); /* make sure data changes  */
+    PROFILE_END(prof, KERNEL_MATRIX_ADD_CONST, begin);
 #if CORE_DEBUG
     printmat(A, N, "matrix_add_const");
 #endif
+    PROFILE_BEGIN(begin);
     matrix_mul_const(N, C, A, val);
+    PROFILE_END(prof, KERNEL_MATRIX_MUL_CONST, begin);
+    PROFILE_BEGIN(begin);
     crc = crc16(matrix_sum(N, C, clipval), crc);
+    PROFILE_END(prof, KERNEL_MATRIX_SUM, begin);
 #if CORE_DEBUG
     printmatC(C, N, "matrix_mul_const");
 #endif
+    PROFILE_BEGIN(begin);
     matrix_mul_vect(N, C, A, B);
+    PROFILE_END(prof, KERNEL_MATRIX_MUL_VECT, begin);
+    PROFILE_BEGIN(begin);
     crc = crc16(matrix_sum(N, C, clipval), crc);
+    PROFILE_END(prof, KERNEL_MATRIX_SUM, begin);
 #if CORE_DEBUG
     printmatC(C, N, "matrix_mul_vect");
 #endif
+    PROFILE_BEGIN(begin);
     matrix_mul_matrix(N, C, A, B);
+    PROFILE_END(prof, KERNEL_MATRIX_MUL_MATRIX, begin);
+    PROFILE_BEGIN(begin);
     crc = crc16(matrix_sum(N, C, clipval), crc);
+    PROFILE_END(prof, KERNEL_MATRIX_SUM, begin);
 #if CORE_DEBUG
     printmatC(C, N, "matrix_mul_matrix");
 #endif
+    PROFILE_BEGIN(begin);
     matrix_mul_matrix_bitextract(N, C, A, B);
+    PROFILE_END(prof, KERNEL_MATRIX_BITEXTRACT, begin);
+    PROFILE_BEGIN(begin);
     crc = crc16(matrix_sum(N, C, clipval), crc);
+    PROFILE_END(prof, KERNEL_MATRIX_SUM, begin);
 #if CORE_DEBUG
     printmatC(C, N, "matrix_mul_matrix_bitextract");
 #endif
 
+    PROFILE_BEGIN(begin);
     matrix_add_const(N, A, -val); /* return matrix to initial value */
+    PROFILE_END(prof, KERNEL_MATRIX_ADD_CONST, begin);
     return crc;
 }
 
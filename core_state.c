@@ -48,12 +48,13 @@ core_bench_state(ee_u32 blksize,
                  ee_s16 seed1,
                  ee_s16 seed2,
                  ee_s16 step,
-                 ee_u16 crc)
+                 ee_u16 crc PROFILE_PARAM)
 {
     ee_u32 final_counts[NUM_CORE_STATES];
     ee_u32 track_counts[NUM_CORE_STATES];
     ee_u8 *p = memblock;
     ee_u32 i;
+    PROFILE_VAR(begin);
 
 #if CORE_DEBUG
     ee_printf("State Bench: %d,%d,%d,%04x\n", seed1, seed2, step, crc);
@@ -63,6 +64,7 @@ core_bench_state(ee_u32 blksize,
         final_counts[i] = track_counts[i] = 0;
     }
     /* run the state machine over the input */
+    PROFILE_BEGIN(begin);
     while (*p != 0)
     {
         enum CORE_STATE fstate = core_state_transition(&p, track_counts);
@@ -74,6 +76,8 @@ core_bench_state(ee_u32 blksize,
 #else
     }
 #endif
+    PROFILE_END(prof, KERNEL_STATE_SCAN, begin);
+    PROFILE_BEGIN(begin);
     p = memblock;
     while (p < (memblock + blksize))
     { /* insert some corruption */
@@ -81,8 +85,10 @@ core_bench_state(ee_u32 blksize,
             *p ^= (ee_u8)seed1;
         p += step;
     }
+    PROFILE_END(prof, KERNEL_STATE_CORRUPT, begin);
     p = memblock;
     /* run the state machine over the input again */
+    PROFILE_BEGIN(begin);
     while (*p != 0)
     {
         enum CORE_STATE fstate = core_state_transition(&p, track_counts);
@@ -94,6 +100,8 @@ core_bench_state(ee_u32 blksize,
 #else
     }
 #endif
+    PROFILE_END(prof, KERNEL_STATE_RESCAN, begin);
+    PROFILE_BEGIN(begin);
     p = memblock;
     while (p < (memblock + blksize))
     { /* undo corruption is seed1 and seed2 are equal */
@@ -101,6 +109,7 @@ core_bench_state(ee_u32 blksize,
             *p ^= (ee_u8)seed2;
         p += step;
     }
+    PROFILE_END(prof, KERNEL_STATE_RESTORE, begin);
     /* end timing */
     for (i = 0; i < NUM_CORE_STATES; i++)
     {
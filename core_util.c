@@ -247,3 +247,118 @@ check_data_types()
     }
     return retval;
 }
+
+#if LATENCY_HISTOGRAM
+/* Function: latency_*
+        Record latencies in a <core_latency> histogram and read percentiles
+   back.
+
+        A percentile is reported as the upper bound of the bucket it falls in,
+   but never more than the largest latency recorded.
+*/
+void
+latency_reset(core_latency *lat)
+{
+    ee_u32 i;
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+        lat->count[i] = 0;
+    lat->total = 0;
+    lat->max   = 0;
+}
+void
+latency_record(core_latency *lat, ee_u64 ns)
+{
+    ee_u32 bucket, msb = LATENCY_SUB_BITS;
+    if (ns < LATENCY_SUB_BUCKETS)
+        bucket = (ee_u32)ns;
+    else
+    {
+        while ((ns >> (msb + 1)) != 0)
+            msb++;
+        bucket = (msb - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS
+                 + (ee_u32)((ns >> (msb - LATENCY_SUB_BITS))
+                            & (LATENCY_SUB_BUCKETS - 1));
+    }
+    lat->count[bucket]++;
+    lat->total++;
+    if (ns > lat->max)
+        lat->max = ns;
+}
+void
+latency_merge(core_latency *to, core_latency *from)
+{
+    ee_u32 i;
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+        to->count[i] += from->count[i];
+    to->total += from->total;
+    if (from->max > to->max)
+        to->max = from->max;
+}
+ee_u64
+latency_percentile(core_latency *lat, ee_u32 permille)
+{
+    ee_u64 rank = (lat->total * permille + 999) / 1000, seen = 0;
+    ee_u32 i;
+    if (rank == 0)
+        rank = 1;
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += lat->count[i];
+        if (seen >= rank)
+        {
+            ee_u64 upper;
+            if (i < LATENCY_SUB_BUCKETS)
+                upper = i;
+            else
+            {
+                ee_u32 shift = i / LATENCY_SUB_BUCKETS - 1;
+                upper = ((ee_u64)(LATENCY_SUB_BUCKETS + i % LATENCY_SUB_BUCKETS
+                                  + 1)
+                         << shift)
+                        - 1;
+            }
+            return (upper < lat->max) ? upper : lat->max;
+        }
+    }
+    return lat->max;
+}
+#endif
+
+#if PERF_COUNTERS
+/* Function: counters_*
+        Accumulate <core_counters>. <counters_add> adds the counts between two
+   reads of <portable_counters_read>, a counter stays valid only if both
+   reads had it. A counter that was multiplexed between the reads has its
+   count scaled by the time it was enabled over the time it was running
+   between them.
+*/
+void
+counters_reset(core_counters *c)
+{
+    ee_u32 i;
+    for (i = 0; i < NUM_COUNTERS; i++)
+        c->value[i] = 0;
+    c->valid = ~(ee_u32)0;
+}
+void
+counters_add(core_counters *to, core_counters *begin, core_counters *end)
+{
+    ee_u32 i;
+    to->valid &= begin->valid & end->valid;
+    for (i = 0; i < NUM_COUNTERS; i++)
+    {
+        ee_u64 count   = end->value[i] - begin->value[i];
+        ee_u64 enabled = end->enabled[i] - begin->enabled[i];
+        ee_u64 running = end->running[i] - begin->running[i];
+        if (running == 0)
+            continue;
+        if (running < enabled)
+#if HAS_FLOAT
+            count = (ee_u64)((double)count * enabled / running);
+#else
+            count = count / running * enabled;
+#endif
+        to->value[i] += count;
+    }
+}
+#endif
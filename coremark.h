@@ -27,6 +27,174 @@ Original Author: Shay Gal-on
 #define TOTAL_DATA_SIZE 2 * 1000
 #endif
 
+/* Configuration: MAX_TRIALS
+        Largest number of timed runs that may be requested with
+   default_num_trials. The time of each run is kept until all are done.
+*/
+#ifndef MAX_TRIALS
+#define MAX_TRIALS 64
+#endif
+
+/* Configuration: MAX_SWEEP_STEPS
+        Largest number of context counts a scaling sweep may step through,
+   see default_sweep.
+*/
+#ifndef MAX_SWEEP_STEPS
+#define MAX_SWEEP_STEPS 32
+#endif
+
+/* Configuration: SIZE_SWEEP_SIZES
+        Data sizes per context, in bytes, that a data size sweep steps
+   through by default, see default_size_sweep. From the size of the standard
+   run, which fits in any L1 cache, out through L2. core_main.c holds the
+   CRCs of the performance and validation seeds at these sizes.
+
+        The time of an iteration grows faster than its size: the list sort
+   reruns the matrix or state benchmark on most compares. An iteration at
+   256K takes about a second, at 1M about a minute. The sweep thus does not
+   reach LLC or DRAM sized data by default, and larger sizes listed
+   explicitly are not validated. For LLC and DRAM sized lists, see
+   <LIST_WIDE> and default_list_items, which grow the list alone.
+*/
+#ifndef SIZE_SWEEP_SIZES
+#define SIZE_SWEEP_SIZES                                                    \
+    2000, 4 * 1024, 8 * 1024, 16 * 1024, 32 * 1024, 64 * 1024, 128 * 1024, \
+        256 * 1024
+#endif
+
+/* Configuration: SIZE_SWEEP_SECS
+        Time every step of a data size sweep is calibrated to run for.
+*/
+#ifndef SIZE_SWEEP_SECS
+#define SIZE_SWEEP_SECS 1
+#endif
+
+/* Configuration: SCAN_SECS
+        Time the measurement on every cpu of a cpu scan is calibrated to run
+   for, see default_scan.
+*/
+#ifndef SCAN_SECS
+#define SCAN_SECS 1
+#endif
+
+/* Configuration: SCAN_DEVIATION
+        Default deviation from the median throughput of a cpu scan, in
+   percent, beyond which a cpu is reported as an outlier.
+*/
+#ifndef SCAN_DEVIATION
+#define SCAN_DEVIATION 5
+#endif
+
+/* Configuration: MIN_RUN_SECS
+        Shortest timed run that gives a valid result. Results to be reported
+   must keep the default of 10 seconds. With a high resolution port timer a
+   shorter run is still measured accurately, so quick checks may lower it.
+*/
+#ifndef MIN_RUN_SECS
+#define MIN_RUN_SECS 10
+#endif
+
+/* Configuration: CALIBRATION_SECS
+        Time the automatically determined number of iterations should run
+   for. A quarter over <MIN_RUN_SECS>, so that a run that ends up noticeably
+   faster than the calibration is still valid.
+*/
+#ifndef CALIBRATION_SECS
+#define CALIBRATION_SECS (MIN_RUN_SECS * 1.25)
+#endif
+
+/* Configuration: CALIBRATION_PROBE_SECS
+        Time a calibration probe must run for before the rate it measured is
+   trusted.
+*/
+#ifndef CALIBRATION_PROBE_SECS
+#define CALIBRATION_PROBE_SECS 0.2
+#endif
+
+/* Configuration: CALIBRATION_PROBES
+        Number of warm probes timed once a probe ran for
+   <CALIBRATION_PROBE_SECS>. The fastest of them is extrapolated to
+   <CALIBRATION_SECS>, so that a cold first probe does not make the timed run
+   too short.
+*/
+#ifndef CALIBRATION_PROBES
+#define CALIBRATION_PROBES 3
+#endif
+
+/* Configuration: CALIBRATION_WARMUP
+        Report the iterations run and the time spent by the calibration, which
+   also serves as warmup for the timed run.
+
+        Valid values:
+        0 - the calibration is not reported (default).
+        1 - the calibration is reported as warmup.
+*/
+#ifndef CALIBRATION_WARMUP
+#define CALIBRATION_WARMUP 0
+#endif
+
+/* Configuration: CONTEXT_STACK
+        With MEM_STACK and multiple contexts, where the data of each context
+   lives.
+
+        Valid values:
+        0 - in a slice of an array on the stack of main, which holds at most
+   MULTITHREAD contexts (default).
+        1 - on the stack of the thread or process that initializes the
+   context, provided by the port, so any number of contexts can run and the
+   data is first touched where the context runs.
+*/
+#ifndef CONTEXT_STACK
+#define CONTEXT_STACK 0
+#endif
+
+/* Configuration: LIST_LINKS
+        How a cell of the list benchmark refers to the next cell and to its
+   data. The list has the same number of items and runs the same operations
+   with any of them, so the CRCs are the same and only the cells get denser.
+
+        Valid values:
+        LIST_POINTERS - native pointers, 16 bytes a cell on 64b hosts
+   (default).
+        LIST_OFFSET32 - 32b offsets from the cell itself, 8 bytes a cell.
+        LIST_OFFSET16 - 16b offsets from the cell itself, 4 bytes a cell, for
+   lists of at most <LIST_OFFSET16_ITEMS> items.
+*/
+#ifndef LIST_LINKS
+#define LIST_LINKS LIST_POINTERS
+#endif
+
+/* Configuration: LIST_LINK_UNIT
+        Bytes an offset of LIST_OFFSET32 or LIST_OFFSET16 counts in. Cells
+   and data items are all 4 bytes apart or more.
+*/
+#ifndef LIST_LINK_UNIT
+#define LIST_LINK_UNIT 4
+#endif
+
+/* Configuration: LIST_WIDE
+        Width of the index and data of a list item.
+
+        Valid values:
+        0 - 16b, the standard list (default). Indexes repeat beyond 16K
+   items.
+        1 - 32b. Indexes follow the same seed derived pattern over 24b
+   rather than 14b, so they keep spreading out up to 16M items, the upper 16b
+   of the data carry a seed derived payload, and the CRCs cover the data of
+   every item walked rather than that of the head. Lists of millions of
+   items, see default_list_items, then still sort and validate meaningfully.
+   The CRCs differ from the standard ones, and have references of their own
+   in core_main.c.
+*/
+#ifndef LIST_WIDE
+#define LIST_WIDE 0
+#endif
+
+/* Longest list 16b offsets reach across: cells and data, the head and tail
+ * included, within 0x7fff units */
+#define LIST_OFFSET16_ITEMS \
+    (0x7fff * LIST_LINK_UNIT / (sizeof(list_head) + sizeof(list_data)) - 2)
+
 #define SEED_ARG      0
 #define SEED_FUNC     1
 #define SEED_VOLATILE 2
@@ -35,6 +203,18 @@ Original Author: Shay Gal-on
 #define MEM_MALLOC 1
 #define MEM_STACK  2
 
+#define OUTPUT_TEXT 0
+#define OUTPUT_JSON 1
+#define OUTPUT_CSV  2
+
+#define SCAN_NONE     0
+#define SCAN_SERIAL   1
+#define SCAN_PARALLEL 2
+
+#define LIST_POINTERS 0
+#define LIST_OFFSET32 1
+#define LIST_OFFSET16 2
+
 #include "core_portme.h"
 
 #if HAS_STDIO
@@ -44,6 +224,19 @@ Original Author: Shay Gal-on
 #define ee_printf printf
 #endif
 
+/* Configuration: OUTPUT_RECORD
+        Compile the machine readable result record selected with
+   default_output_format. The whole record is formatted into one buffer once
+   all runs are done and printed at once, so it needs vsnprintf from
+   <HAS_STDIO>.
+*/
+#ifndef OUTPUT_RECORD
+#define OUTPUT_RECORD HAS_STDIO
+#endif
+#if OUTPUT_RECORD
+#include <stdarg.h>
+#endif
+
 /* Actual benchmark execution in iterate */
 void *iterate(void *pres);
 
@@ -88,17 +281,46 @@ ee_s32 parseval(char *valstring);
 #define NUM_ALGORITHMS      3
 
 /* list data structures */
+#if LIST_WIDE
+typedef ee_s32 list_value;
+#else
+typedef ee_s16 list_value;
+#endif
 typedef struct list_data_s
 {
-    ee_s16 data16;
-    ee_s16 idx;
+    list_value data16; /* the low 16b are the data, see core_list_join.c */
+    list_value idx;
 } list_data;
 
+#if (LIST_LINKS == LIST_POINTERS)
 typedef struct list_head_s
 {
     struct list_head_s *next;
     struct list_data_s *info;
 } list_head;
+#else
+#if (LIST_LINKS == LIST_OFFSET16)
+typedef ee_s16 list_link;
+#else
+typedef ee_s32 list_link;
+#endif
+typedef struct list_head_s
+{
+    list_link next; /* offsets from the cell, see core_list_join.c */
+    list_link info;
+} list_head;
+#endif
+
+/* Items in a list built in <blksize> bytes. A cell is counted as 16 bytes
+ * whatever its size, to accommodate systems with 64b pointers and make sure
+ * the same code is executed, so every LIST_LINKS runs the same list. */
+#define LIST_ITEMS(blksize) ((blksize) / (16 + sizeof(list_data)) - 2)
+/* Bytes a list of <items> items is built in, the inverse of LIST_ITEMS */
+#define LIST_BLOCK(items) (((items) + 2) * (ee_u32)(16 + sizeof(list_data)))
+/* <offset> rounded up so that list cells placed there are aligned */
+#define LIST_ALIGN(offset)                               \
+    (((offset) + (ee_u32)sizeof(void *) - 1)             \
+     & ~((ee_u32)sizeof(void *) - 1))
 
 /*matrix benchmark related stuff */
 #define MATDAT_INT 1
@@ -133,8 +355,134 @@ typedef enum CORE_STATE
     NUM_CORE_STATES
 } core_state_e;
 
+#if LATENCY_HISTOGRAM || KERNEL_PROFILE
+ee_u64 portable_clock_ns(void);
+#endif
+
+#if LATENCY_HISTOGRAM
+/* Typedef: core_latency
+        Log-linear histogram of iteration latencies in nanoseconds. Values
+   below <LATENCY_SUB_BUCKETS> have a bucket each, and every power of two
+   above that is split into <LATENCY_SUB_BUCKETS> buckets of equal width, so
+   a latency is known to within 1/<LATENCY_SUB_BUCKETS> of its value.
+
+        Each context only records into its own histogram, so no locking is
+   needed. Histograms of several contexts are combined with <latency_merge>.
+*/
+#define LATENCY_SUB_BITS    4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS     ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+typedef struct CORE_LATENCY_S
+{
+    ee_u32 count[LATENCY_BUCKETS];
+    ee_u64 total;
+    ee_u64 max;
+} core_latency;
+
+void   latency_reset(core_latency *lat);
+void   latency_record(core_latency *lat, ee_u64 ns);
+void   latency_merge(core_latency *to, core_latency *from);
+ee_u64 latency_percentile(core_latency *lat, ee_u32 permille);
+#endif
+
+#if PERF_COUNTERS
+/* Typedef: core_counters
+        Performance counters of a context over the timed region. The port
+   reads them with <portable_counters_read>, which sets a bit in <valid> for
+   every counter it could read, so missing hardware counters are simply not
+   reported. A read also gives the time each counter was enabled and running
+   so far, which <counters_add> uses to scale multiplexed counts.
+*/
+typedef enum CORE_COUNTER
+{
+    COUNTER_CYCLES = 0,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_TASK_CLOCK, /* nanoseconds */
+    COUNTER_CONTEXT_SWITCHES,
+    COUNTER_PAGE_FAULTS,
+    NUM_COUNTERS
+} core_counter_e;
+
+typedef struct CORE_COUNTERS_S
+{
+    ee_u64 value[NUM_COUNTERS];
+    ee_u64 enabled[NUM_COUNTERS]; /* nanoseconds, of a read only */
+    ee_u64 running[NUM_COUNTERS]; /* nanoseconds, of a read only */
+    ee_u32 valid;
+} core_counters;
+
+void portable_counters_read(core_counters *now);
+void counters_reset(core_counters *c);
+void counters_add(core_counters *to, core_counters *begin, core_counters *end);
+#endif
+
+/* Typedef: core_profile
+        Calls and nanoseconds spent per kernel with <KERNEL_PROFILE>. Times
+   are inclusive: list mergesort contains the calc_func misses it caused, and
+   those contain the matrix and state kernels. calc_func hits are only
+   counted, they take less time than reading the clock.
+
+        The PROFILE_* macros expand to nothing when <KERNEL_PROFILE> is 0, so
+   the kernels are unchanged then. PROFILE_PARAM and PROFILE_ARG hand the
+   profile of the context down to kernels that do not see its results.
+*/
+#if KERNEL_PROFILE
+typedef enum CORE_KERNEL
+{
+    KERNEL_LIST_FIND = 0,
+    KERNEL_LIST_REVERSE,
+    KERNEL_LIST_MERGESORT,
+    KERNEL_CALC_HIT,
+    KERNEL_CALC_MISS,
+    KERNEL_MATRIX_ADD_CONST,
+    KERNEL_MATRIX_MUL_CONST,
+    KERNEL_MATRIX_MUL_VECT,
+    KERNEL_MATRIX_MUL_MATRIX,
+    KERNEL_MATRIX_BITEXTRACT,
+    KERNEL_MATRIX_SUM,
+    KERNEL_STATE_SCAN,
+    KERNEL_STATE_CORRUPT,
+    KERNEL_STATE_RESCAN,
+    KERNEL_STATE_RESTORE,
+    NUM_KERNELS
+} core_kernel_e;
+
+typedef struct CORE_PROFILE_S
+{
+    ee_u64 calls[NUM_KERNELS];
+    ee_u64 ns[NUM_KERNELS];
+} core_profile;
+
+#define PROFILE_PARAM        , core_profile *prof
+#define PROFILE_ARG(p)       , (p)
+#define PROFILE_VAR(t)       ee_u64 t
+#define PROFILE_BEGIN(t)     (t) = portable_clock_ns()
+#define PROFILE_COUNT(p, k)  (p)->calls[k]++
+#define PROFILE_END(p, k, t) \
+    ((p)->calls[k]++, (p)->ns[k] += portable_clock_ns() - (t))
+#else
+#define PROFILE_PARAM
+#define PROFILE_ARG(p)
+#define PROFILE_VAR(t)
+#define PROFILE_BEGIN(t)
+#define PROFILE_COUNT(p, k)
+#define PROFILE_END(p, k, t)
+#endif
+
+/* Configuration: CONTEXT_ALIGN
+        Alignment attribute for <core_results>, defined by ports that keep
+   contexts from sharing cache lines. <portable_malloc> must then return
+   memory aligned at least as strictly. Empty by default.
+*/
+#ifndef CONTEXT_ALIGN
+#define CONTEXT_ALIGN
+#endif
+
 /* Helper structure to hold results */
-typedef struct RESULTS_S
+typedef struct CONTEXT_ALIGN RESULTS_S
 {
     /* inputs */
     ee_s16              seed1;       /* Initializing seed */
@@ -145,6 +493,7 @@ typedef struct RESULTS_S
     ee_u32              iterations;  /* Number of iterations to execute */
     ee_u32              execs;       /* Bitmask of operations to execute */
     struct list_head_s *list;
+    void *              list_block;  /* Block the list is scattered over */
     mat_params          mat;
     /* outputs */
     ee_u16 crc;
@@ -152,18 +501,62 @@ typedef struct RESULTS_S
     ee_u16 crcmatrix;
     ee_u16 crcstate;
     ee_s16 err;
+    /* ticks relative to start_time() when this context started and stopped */
+    CORE_TICKS start_ticks;
+    CORE_TICKS stop_ticks;
+    /* where the context ran and where its data lives, -1 if unknown */
+    ee_s32 cpu;
+    ee_s32 mem_node;
+#if LATENCY_HISTOGRAM
+    core_latency latency; /* latency of every iteration */
+#endif
+#if KERNEL_PROFILE
+    core_profile profile; /* time spent per kernel */
+#endif
+#if PERF_COUNTERS
+    core_counters counters; /* performance counters of the timed region */
+#endif
     /* ultithread specific */
     core_portable port;
 } core_results;
 
+/* Acquire and initialize the data of one context */
+ee_u8 core_init_context(core_results *res);
+/* Bytes of the memory block of one context */
+ee_u32 core_context_size(core_results *res);
+
+/* Configuration: HAS_MEMBLOCK_ALLOC
+        Define to 1 if the port places the data of the contexts itself, with
+   <portable_memblock_alloc> and <portable_memblock_free>. Otherwise the data
+   comes from <portable_malloc>.
+*/
+#ifndef HAS_MEMBLOCK_ALLOC
+#define HAS_MEMBLOCK_ALLOC 0
+#endif
+#if HAS_MEMBLOCK_ALLOC
+void *portable_memblock_alloc(ee_size_t size, core_results *res);
+void  portable_memblock_free(void *p);
+#else
+#define portable_memblock_alloc(size, res) portable_malloc(size)
+#define portable_memblock_free(p)          portable_free(p)
+#endif
+/* Run part of the iterations of a context, continuing its CRCs */
+void iterate_batch(core_results *res, ee_u32 first, ee_u32 count);
+
 /* Multicore execution handling */
 #if (MULTITHREAD > 1)
 ee_u8 core_start_parallel(core_results *res);
+ee_u8 core_wait_parallel(void);
+ee_u8 core_release_parallel(void);
 ee_u8 core_stop_parallel(core_results *res);
 #endif
 
 /* list benchmark functions */
 list_head *core_list_init(ee_u32 blksize, list_head *memblock, ee_s16 seed);
+list_head *core_list_scatter(list_head *list,
+                             void *     block,
+                             ee_u32     footprint,
+                             ee_s16     seed);
 ee_u16     core_bench_list(core_results *res, ee_s16 finder_idx);
 
 /* state benchmark functions */
@@ -173,11 +566,11 @@ ee_u16 core_bench_state(ee_u32 blksize,
                         ee_s16 seed1,
                         ee_s16 seed2,
                         ee_s16 step,
-                        ee_u16 crc);
+                        ee_u16 crc PROFILE_PARAM);
 
 /* matrix benchmark functions */
 ee_u32 core_init_matrix(ee_u32      blksize,
                         void *      memblk,
                         ee_s32      seed,
                         mat_params *p);
-ee_u16 core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc);
+ee_u16 core_bench_matrix(mat_params *p, ee_s16 seed, ee_u16 crc PROFILE_PARAM);
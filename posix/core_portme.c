@@ -16,21 +16,35 @@ limitations under the License.
 Original Author: Shay Gal-on
 */
 
+#if defined(__linux__)
+#define _GNU_SOURCE /* for sched_setaffinity and sched_getcpu */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "coremark.h"
 #if CALLGRIND_RUN
 #include <valgrind/callgrind.h>
 #endif
 
-#if (MEM_METHOD == MEM_MALLOC)
 /* Function: portable_malloc
         Provide malloc() functionality in a platform specific way.
+
+        Always backed by the heap on posix, since the context array for
+   multiple contexts is sized at run time regardless of <MEM_METHOD>. Blocks
+   are aligned to <CACHE_LINE_SIZE>, as <CONTEXT_ALIGN> requires.
 */
 void *
 portable_malloc(size_t size)
 {
-    return malloc(size);
+    void *p;
+    if (posix_memalign(&p, CACHE_LINE_SIZE, size) != 0)
+        return NULL;
+    return p;
 }
 /* Function: portable_free
         Provide free() functionality in a platform specific way.
@@ -40,18 +54,255 @@ portable_free(void *p)
 {
     free(p);
 }
-#else
+
+/* Memory blocks:
+        The data of every context comes from <portable_memblock_alloc>. By
+   default that is a heap block aligned to <CACHE_LINE_SIZE>. The A argument
+   selects another placement, see <memblock_parse>:
+
+        heap - posix_memalign.
+        pages - an anonymous mapping that is kept on small pages.
+        thp - an anonymous mapping aligned to <HUGE_PAGE_SIZE> and advised to
+   use transparent huge pages.
+        hugetlb - an anonymous MAP_HUGETLB mapping, which needs huge pages
+   reserved in /proc/sys/vm/nr_hugepages. Falls back to small pages.
+
+        A header in front of each block records how to free it. The colour
+   shifts the block of the n-th context by n times the colour within a page,
+   so that the blocks of different contexts do not start on the same cache
+   sets.
+*/
+#define MEMBLOCK_HEAP    0
+#define MEMBLOCK_PAGES   1
+#define MEMBLOCK_THP     2
+#define MEMBLOCK_HUGETLB 3
+
+static const char *memblock_names[] = { "heap", "pages", "thp", "hugetlb" };
+
+static ee_u8  memblock_kind   = MEMBLOCK_HEAP;
+static size_t memblock_align  = CACHE_LINE_SIZE;
+static size_t memblock_colour = 0;
+static ee_u8  memblock_lock   = 0;
+
+/* what actually happened, shared so that forked contexts report it too */
+typedef struct MEMBLOCK_OUTCOME_S
+{
+    ee_u8 huge_failed; /* no hugetlb pages, small pages used instead */
+    ee_u8 lock_failed;
+} memblock_outcome;
+static memblock_outcome  memblock_local;
+static memblock_outcome *memblock_seen = &memblock_local;
+
+typedef struct MEMBLOCK_HEADER_S
+{
+    void * start; /* of the heap block or mapping */
+    size_t length;
+    ee_u8  kind;
+} memblock_header;
+
+static size_t
+memblock_round(size_t n, size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+static size_t
+memblock_page(ee_u8 kind)
+{
+    if ((kind == MEMBLOCK_THP) || (kind == MEMBLOCK_HUGETLB))
+        return HUGE_PAGE_SIZE;
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+/* Function: memblock_map
+        Allocate a block of <size> bytes for the context started <slot>th,
+   faulting in all of it if <populate> is set.
+*/
+static void *
+memblock_map(size_t size, ee_u32 slot, ee_u8 populate)
+{
+    ee_u8  kind = memblock_kind;
+    size_t head = memblock_round(sizeof(memblock_header), memblock_align);
+    size_t offset, length = 0, base_align;
+    int    flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void * start = MAP_FAILED;
+    ee_u8 *base  = NULL;
+    memblock_header *hdr;
+
+    if (kind == MEMBLOCK_HUGETLB)
+    {
+        offset = head + (slot * memblock_colour) % HUGE_PAGE_SIZE;
+        length = memblock_round(offset + size, HUGE_PAGE_SIZE);
+        start  = mmap(NULL,
+                     length,
+                     PROT_READ | PROT_WRITE,
+                     flags | MAP_HUGETLB | (populate ? MAP_POPULATE : 0),
+                     -1,
+                     0);
+        base   = (ee_u8 *)start;
+        if (start == MAP_FAILED)
+        {
+            memblock_seen->huge_failed = 1;
+            kind                       = MEMBLOCK_PAGES;
+        }
+    }
+    offset = head + (slot * memblock_colour) % memblock_page(kind);
+    if (kind == MEMBLOCK_HEAP)
+    {
+        length = offset + size;
+        if (posix_memalign(&start, memblock_align, length) != 0)
+            return NULL;
+        base = (ee_u8 *)start;
+        if (populate)
+            memset(base, 0, length);
+    }
+    else if (kind != MEMBLOCK_HUGETLB)
+    {
+        /* map enough to align the start, and unmap all of it on free */
+        base_align = memblock_page(kind);
+        if (memblock_align > base_align)
+            base_align = memblock_align;
+        length = memblock_round(offset + size, memblock_page(kind))
+                 + base_align;
+        /* huge pages are only used for pages faulted in after the advice */
+        if (populate && (kind == MEMBLOCK_PAGES))
+            flags |= MAP_POPULATE;
+        start = mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (start == MAP_FAILED)
+            return NULL;
+        base = (ee_u8 *)memblock_round((size_t)start, base_align);
+        madvise(base,
+                offset + size,
+                (kind == MEMBLOCK_THP) ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+        if (populate && (kind == MEMBLOCK_THP))
+            memset(base, 0, offset + size);
+    }
+    hdr         = (memblock_header *)(base + offset) - 1;
+    hdr->start  = start;
+    hdr->length = length;
+    hdr->kind   = kind;
+    if (memblock_lock && (mlock(base + offset, size) != 0))
+        memblock_seen->lock_failed = 1;
+    return base + offset;
+}
+/* Function: memblock_parse
+        Select the placement of the memory blocks from the A argument, a comma
+   separated list of:
+
+        heap, pages, thp or hugetlb - the kind of memory, see <Memory blocks>.
+        <n> - align blocks to <n> bytes, a power of two, K and M allowed.
+        c<n> - colour blocks by <n> bytes, rounded up to the alignment. Needs
+   a mapping, so it selects pages over the heap.
+        lock - fault in and mlock every block.
+*/
+static void
+memblock_parse(char *spec)
+{
+    while (*spec)
+    {
+        size_t len = strcspn(spec, ","), k;
+        for (k = 0; k < sizeof(memblock_names) / sizeof(memblock_names[0]);
+             k++)
+        {
+            if ((strlen(memblock_names[k]) == len)
+                && (strncmp(spec, memblock_names[k], len) == 0))
+                break;
+        }
+        if (k < sizeof(memblock_names) / sizeof(memblock_names[0]))
+            memblock_kind = (ee_u8)k;
+        else if ((len == 4) && (strncmp(spec, "lock", 4) == 0))
+            memblock_lock = 1;
+        else if ((spec[0] == 'c') && isdigit((unsigned char)spec[1]))
+            memblock_colour = (size_t)parseval(spec + 1);
+        else if (isdigit((unsigned char)spec[0]))
+        {
+            size_t n = (size_t)parseval(spec);
+            if ((n >= sizeof(void *)) && ((n & (n - 1)) == 0))
+                memblock_align = n;
+            else
+                ee_printf("ERROR! Alignment %lu is not a power of two\n",
+                          (long unsigned)n);
+        }
+        else
+            ee_printf("ERROR! Unknown memory placement %.*s\n", (int)len, spec);
+        spec += len;
+        if (*spec == ',')
+            spec++;
+    }
+    memblock_colour = memblock_round(memblock_colour, memblock_align);
+    if ((memblock_colour > 0) && (memblock_kind == MEMBLOCK_HEAP))
+        memblock_kind = MEMBLOCK_PAGES;
+}
+#if (MULTITHREAD > 1) && (USE_FORK || USE_SOCKET)
+/* Function: memblock_share
+        Keep <memblock_outcome> in a shared mapping, so that forked contexts
+   report what their allocations did to the parent.
+*/
+static void
+memblock_share(void)
+{
+    void *shared = mmap(NULL,
+                        sizeof(memblock_outcome),
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS,
+                        -1,
+                        0);
+    if (shared != MAP_FAILED)
+        memblock_seen = (memblock_outcome *)shared;
+}
+#endif
+#if (MEM_METHOD == MEM_MALLOC)
+/* Function: memblock_report
+        Print the placement of the memory blocks.
+*/
+static void
+memblock_report(void)
+{
+    ee_printf("Memory blocks    : %s, %lu byte aligned",
+              memblock_names[memblock_kind],
+              (long unsigned)memblock_align);
+    if (memblock_colour > 0)
+        ee_printf(", colour %lu", (long unsigned)memblock_colour);
+    if (memblock_lock)
+        ee_printf(", locked");
+    if (memblock_seen->huge_failed)
+        ee_printf(" (no hugetlb pages, small pages used)");
+    if (memblock_seen->lock_failed)
+        ee_printf(" (mlock failed)");
+    ee_printf("\n");
+}
+#endif
+/* Function: portable_memblock_alloc
+        Allocate the data memory block of a context, placed as selected with
+   the A argument.
+*/
 void *
-portable_malloc(size_t size)
+portable_memblock_alloc(ee_size_t size, core_results *res)
 {
-    return NULL;
+#if (MULTITHREAD > 1)
+    return memblock_map(size, res->port.slot, memblock_lock);
+#else
+    (void)res;
+    return memblock_map(size, 0, memblock_lock);
+#endif
 }
+/* Function: portable_memblock_free
+        Release a block from <portable_memblock_alloc>.
+*/
 void
-portable_free(void *p)
+portable_memblock_free(void *p)
 {
-    p = NULL;
+    memblock_header *hdr;
+    if (p == NULL)
+        return;
+    hdr = (memblock_header *)p - 1;
+    if (hdr->kind != MEMBLOCK_HEAP)
+    { /* unmapping also unlocks */
+        munmap(hdr->start, hdr->length);
+        return;
+    }
+    if (memblock_lock)
+        munlock(p, hdr->length - (size_t)((ee_u8 *)p - (ee_u8 *)hdr->start));
+    free(hdr->start);
 }
-#endif
 
 #if (SEED_METHOD == SEED_VOLATILE)
 #if VALIDATION_RUN
@@ -86,7 +337,36 @@ volatile ee_s32 seed5_volatile = 0;
    does not occur. If there are issues with the return value overflowing,
    increase this value.
         */
-#if USE_CLOCK
+#if USE_TSC
+/* ticks are nanoseconds, converted from the time stamp counter with the
+ * rate measured in <timer_calibrate> */
+static double tsc_ns_per_count = 1.0;
+static int    tsc_usable       = 0;
+static ee_u64 portable_timer_read(void);
+#define NSECS_PER_SEC        1000000000
+#define EE_TIMER_TICKER_RATE 1000
+#define CORETIMETYPE         ee_u64
+#define GETMYTIME(_t)        (*_t = portable_timer_read())
+#define MYTIMEDIFF(fin, ini) \
+    ((ee_u64)(((fin) - (ini)) * tsc_ns_per_count) / TIMER_RES_DIVIDER)
+#ifndef TIMER_RES_DIVIDER
+#define TIMER_RES_DIVIDER 1
+#endif
+#define SAMPLE_TIME_IMPLEMENTATION 1
+#elif USE_MONOTONIC_RAW
+#define NSECS_PER_SEC        1000000000
+#define EE_TIMER_TICKER_RATE 1000
+#define CORETIMETYPE         struct timespec
+#define GETMYTIME(_t)        clock_gettime(CLOCK_MONOTONIC_RAW, _t)
+#define MYTIMEDIFF(fin, ini)                                         \
+    ((fin.tv_sec - ini.tv_sec) * (NSECS_PER_SEC / TIMER_RES_DIVIDER) \
+     + (fin.tv_nsec - ini.tv_nsec) / TIMER_RES_DIVIDER)
+/* nanosecond resolution by default */
+#ifndef TIMER_RES_DIVIDER
+#define TIMER_RES_DIVIDER 1
+#endif
+#define SAMPLE_TIME_IMPLEMENTATION 1
+#elif USE_CLOCK
 #define NSECS_PER_SEC              CLOCKS_PER_SEC
 #define EE_TIMER_TICKER_RATE       1000
 #define CORETIMETYPE               clock_t
@@ -127,6 +407,11 @@ volatile ee_s32 seed5_volatile = 0;
 #if SAMPLE_TIME_IMPLEMENTATION
 /** Define Host specific (POSIX), or target specific global time variables. */
 static CORETIMETYPE start_time_val, stop_time_val;
+/* Common time base for per context timing, captured in <portable_init> so
+   that it is shared by threads and forked children alike. */
+static CORETIMETYPE epoch_time_val;
+/* Ticks one timer read takes, see <timer_calibrate> */
+static CORE_TICKS timer_overhead = 0;
 
 /* Function: start_time
         This function will be called right before starting the timed portion of
@@ -180,6 +465,9 @@ get_time(void)
 {
     CORE_TICKS elapsed
         = (CORE_TICKS)(MYTIMEDIFF(stop_time_val, start_time_val));
+    /* the timed region includes one timer read */
+    if (elapsed > timer_overhead)
+        elapsed -= timer_overhead;
     return elapsed;
 }
 /* Function: time_in_secs
@@ -195,226 +483,2093 @@ time_in_secs(CORE_TICKS ticks)
     secs_ret retval = ((secs_ret)ticks) / (secs_ret)EE_TICKS_PER_SEC;
     return retval;
 }
-#else
-#error "Please implement timing functionality in core_portme.c"
-#endif /* SAMPLE_TIME_IMPLEMENTATION */
-
-ee_u32 default_num_contexts = MULTITHREAD;
+#if LATENCY_HISTOGRAM || KERNEL_PROFILE
+/* Function: portable_clock_ns
+        Cheap monotonic nanosecond clock used to time single iterations with
+   <LATENCY_HISTOGRAM> and kernels with <KERNEL_PROFILE>. On Linux
+   clock_gettime is served from the vdso without a system call.
+*/
+ee_u64
+portable_clock_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ee_u64)now.tv_sec * 1000000000 + (ee_u64)now.tv_nsec;
+}
+#endif
+#if USE_TSC
+/* Function: portable_timer_read
+        Read the time stamp counter, or CLOCK_MONOTONIC_RAW in nanoseconds
+   when the counter is not invariant.
+*/
+static ee_u64
+portable_timer_read(void)
+{
+    struct timespec now;
+    if (tsc_usable)
+        return __rdtsc();
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (ee_u64)now.tv_sec * 1000000000 + (ee_u64)now.tv_nsec;
+}
+#endif
+/* Function: timer_calibrate
+        With <USE_TSC>, check that the time stamp counter is invariant, that
+   is, it runs at a constant rate through frequency and power state changes,
+   and measure that rate against CLOCK_MONOTONIC_RAW over
+   <TSC_CALIBRATION_MS>.
 
-/* Function: portable_init
-        Target specific initialization code
-        Test for some common mistakes.
+        Then measure the overhead of a timer read as the smallest difference
+   between two back to back reads, which <get_time> subtracts.
 */
-void
-portable_init(core_portable *p, int *argc, char *argv[])
+static void
+timer_calibrate(void)
 {
-#if PRINT_ARGS
-    int i;
-    for (i = 0; i < *argc; i++)
+    CORETIMETYPE a, b;
+    CORE_TICKS   diff;
+    ee_u32       i;
+#if USE_TSC
+    unsigned int    eax, ebx, ecx, edx;
+    struct timespec t0, t1;
+    ee_u64          c0, c1, ns;
+    tsc_usable = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)
+                 && (edx & (1 << 8));
+    if (tsc_usable)
     {
-        ee_printf("Arg[%d]=%s\n", i, argv[i]);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+        c0 = __rdtsc();
+        do
+        {
+            clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+            ns = (ee_u64)(t1.tv_sec - t0.tv_sec) * 1000000000
+                 + t1.tv_nsec - t0.tv_nsec;
+        } while (ns < (ee_u64)TSC_CALIBRATION_MS * 1000000);
+        c1               = __rdtsc();
+        tsc_ns_per_count = (double)ns / (double)(c1 - c0);
     }
 #endif
-
-    (void)argc; // prevent unused warning
-    (void)argv; // prevent unused warning
-    
-    if (sizeof(ee_ptr_int) != sizeof(ee_u8 *))
+    for (i = 0; i < 1000; i++)
     {
-        ee_printf(
-            "ERROR! Please define ee_ptr_int to a type that holds a "
-            "pointer!\n");
+        GETMYTIME(&a);
+        GETMYTIME(&b);
+        diff = (CORE_TICKS)(MYTIMEDIFF(b, a));
+        if ((i == 0) || (diff < timer_overhead))
+            timer_overhead = diff;
     }
-    if (sizeof(ee_u32) != 4)
+}
+
+#if PERF_COUNTERS
+/* Performance counters:
+        Every thread opens its own counters the first time it reads them, one
+   perf_event_open file per counter so that each is multiplexed on its own
+   when the PMU has fewer counters than requested. Reads keep the raw count
+   and times, and <counters_add> scales the count between two reads by the
+   fraction of time it was actually running. The kernel is counted
+   too when perf_event_paranoid allows it, user space only otherwise.
+*/
+static const struct
+{
+    ee_u32 type;
+    ee_u64 config;
+} perf_event[NUM_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+static __thread ee_u8 perf_opened = 0;
+static __thread int   perf_fd[NUM_COUNTERS];
+
+/* Function: perf_open
+        Open the counters of the calling thread, if it has not yet.
+*/
+static void
+perf_open(void)
+{
+    struct perf_event_attr attr;
+    ee_u32                 i;
+    if (perf_opened)
+        return;
+    for (i = 0; i < NUM_COUNTERS; i++)
     {
-        ee_printf("ERROR! Please define ee_u32 to a 32b unsigned type!\n");
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = perf_event[i].type;
+        attr.config         = perf_event[i].config;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED
+                           | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        perf_fd[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if ((perf_fd[i] < 0) && ((errno == EACCES) || (errno == EPERM)))
+        { /* not allowed to count the kernel, count user space only */
+            attr.exclude_kernel = 1;
+            perf_fd[i]
+                = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
     }
-#if (MAIN_HAS_NOARGC && (SEED_METHOD == SEED_ARG))
-    ee_printf(
-        "ERROR! Main has no argc, but SEED_METHOD defined to SEED_ARG!\n");
+    perf_opened = 1;
+}
+#if (MULTITHREAD > 1)
+/* Function: perf_close
+        Close the counters of the calling thread.
+*/
+static void
+perf_close(void)
+{
+    ee_u32 i;
+    if (!perf_opened)
+        return;
+    for (i = 0; i < NUM_COUNTERS; i++)
+        if (perf_fd[i] >= 0)
+            close(perf_fd[i]);
+    perf_opened = 0;
+}
 #endif
-
-#if (MULTITHREAD > 1) && (SEED_METHOD == SEED_ARG)
-    int nargs = *argc, i;
-    if ((nargs > 1) && (*argv[1] == 'M'))
+/* Function: portable_counters_read
+        Read the counters of the calling thread, opening them on first use.
+*/
+void
+portable_counters_read(core_counters *now)
+{
+    ee_u64 raw[3]; /* value, time enabled, time running */
+    ee_u32 i;
+    perf_open();
+    now->valid = 0;
+    for (i = 0; i < NUM_COUNTERS; i++)
     {
-        default_num_contexts = parseval(argv[1] + 1);
-        if (default_num_contexts > MULTITHREAD)
-            default_num_contexts = MULTITHREAD;
-        /* Shift args since first arg is directed to the portable part and not
-         * to coremark main */
-        --nargs;
-        for (i = 1; i < nargs; i++)
-            argv[i] = argv[i + 1];
-        *argc = nargs;
+        now->value[i] = now->enabled[i] = now->running[i] = 0;
+        if ((perf_fd[i] < 0)
+            || (read(perf_fd[i], raw, sizeof(raw)) != sizeof(raw)))
+            continue;
+        now->value[i]   = raw[0];
+        now->enabled[i] = raw[1];
+        now->running[i] = raw[2];
+        now->valid |= 1 << i;
     }
-#endif /* sample of potential platform specific init via command line, reset \
-          the number of contexts being used if first argument is M<n>*/
-    p->portable_id = 1;
 }
-/* Function: portable_fini
-        Target specific final code
+#endif
+#if (MULTITHREAD > 1)
+/* Function: portable_ticks
+        Ticks elapsed since <portable_init>. Used to time each context on its
+   own, in the same units as <get_time>.
 */
-void
-portable_fini(core_portable *p)
+static CORE_TICKS
+portable_ticks(void)
 {
-    p->portable_id = 0;
+    CORETIMETYPE now;
+    GETMYTIME(&now);
+    return (CORE_TICKS)(MYTIMEDIFF(now, epoch_time_val));
 }
+/* Function: portable_start_ticks
+        The value <portable_ticks> had when <start_time> was called.
+*/
+static CORE_TICKS
+portable_start_ticks(void)
+{
+    return (CORE_TICKS)(MYTIMEDIFF(start_time_val, epoch_time_val));
+}
+#endif
+#else
+#error "Please implement timing functionality in core_portme.c"
+#endif /* SAMPLE_TIME_IMPLEMENTATION */
+
+ee_u32 default_num_contexts  = MULTITHREAD;
+ee_u32 default_duration      = 0;
+ee_u32 default_num_trials    = 1;
+ee_u32 default_output_format = OUTPUT_TEXT;
+ee_u32 default_sweep[MAX_SWEEP_STEPS];
+ee_u32 default_num_sweep = 0;
+ee_u32 default_size_sweep[MAX_SWEEP_STEPS];
+ee_u32 default_num_size_sweep = 0;
+ee_u32 default_list_footprint = 0;
+ee_u32 default_list_items     = 0;
+ee_u32 default_scan           = SCAN_NONE;
+ee_u32 default_num_scan_cpus  = 0;
+ee_s32 default_scan_step      = -1;
+ee_u32 default_scan_deviation = SCAN_DEVIATION;
 
 #if (MULTITHREAD > 1)
+/* CPU limits:
+        The cpus the process may use: the cpus online and, on Linux, the
+   affinity mask, the effective cpuset and the cpu.max quota of the cgroup v2
+   of the process or any of its ancestors. The usable number is the smallest
+   of them, with a quota rounded down to whole cpus but at least one, so that
+   a container gets one context per cpu it can actually run on without being
+   throttled.
+*/
+typedef struct CPU_LIMITS_S
+{
+    ee_u32 online;
+    ee_u32 affinity; /* 0 where unknown */
+    ee_u32 cpuset;   /* 0 where unknown */
+    long   quota;    /* runtime per period of cpu.max, 0 without a quota */
+    long   period;
+    ee_u32 usable;
+} cpu_limits;
+static cpu_limits cpu_limit;
+/* set when the number of contexts was given with M<n> */
+static ee_u8 contexts_given = 0;
 
-/* Function: core_start_parallel
-        Start benchmarking in a parallel context.
+#if HAS_AFFINITY
+static void cpu_limits_linux(cpu_limits *l); /* after <parse_cpu_list> */
+#endif
 
-        Three implementations are provided, one using pthreads, one using fork
-   and shared mem, and one using fork and sockets. Other implementations using
-   MCAPI or other standards can easily be devised.
+/* Function: portable_num_cpus
+        Number of cpus the process can use, see <CPU limits>. Used when the
+   number of contexts is requested as M0, for the default pool of workers
+   and, with <CONTEXTS_FROM_CPUS>, for the default number of contexts.
 */
-/* Function: core_stop_parallel
-        Stop a parallel context execution of coremark, and gather the results.
-
-        Three implementations are provided, one using pthreads, one using fork
-   and shared mem, and one using fork and sockets. Other implementations using
-   MCAPI or other standards can easily be devised.
+static ee_u32
+portable_num_cpus(void)
+{
+    cpu_limits *l = &cpu_limit;
+    long        ncpus;
+    if (l->usable > 0)
+        return l->usable;
+    ncpus     = sysconf(_SC_NPROCESSORS_ONLN);
+    l->online = (ncpus < 1) ? 1 : (ee_u32)ncpus;
+    l->usable = l->online;
+#if HAS_AFFINITY
+    cpu_limits_linux(l);
+#endif
+    return l->usable;
+}
+/* Function: cpu_limits_report
+        Print the <CPU limits> found, so that scores from containers can be
+   compared with bare metal.
 */
-#if USE_PTHREAD
-ee_u8
-core_start_parallel(core_results *res)
+static void
+cpu_limits_report(void)
 {
-    return (ee_u8)pthread_create(
-        &(res->port.thread), NULL, iterate, (void *)res);
+    cpu_limits *l = &cpu_limit;
+    portable_num_cpus();
+    ee_printf("CPU limits       : %u online", l->online);
+    if (l->affinity > 0)
+        ee_printf(", affinity %u", l->affinity);
+    if (l->cpuset > 0)
+        ee_printf(", cpuset %u", l->cpuset);
+    if (l->quota > 0)
+        ee_printf(", quota %ld/%ld", l->quota, l->period);
+    ee_printf(", %u usable, %u contexts %s\n",
+              l->usable,
+              default_num_contexts,
+              contexts_given ? "requested" : "by default");
 }
-ee_u8
-core_stop_parallel(core_results *res)
+
+#if HAS_AFFINITY
+/* Placement:
+        Contexts, or the workers of <USE_POOL>, can be pinned to cpus with a
+   P<policy> argument:
+
+        Pcompact - fill the cpus of one numa node before moving on to the next,
+   with the SMT siblings of a core next to each other.
+        Pscatter - spread over numa nodes first, then over the cores of each
+   node, and use SMT siblings last.
+        P<list> - use an explicit cpu list in the given order, e.g. P0-3,8.
+
+        Slot <n> runs on the <n>th cpu of the placement, wrapping around when
+   there are more slots than cpus. Compact and scatter only use cpus in the
+   affinity mask of the process. Each context initializes its own data after
+   it has been pinned, so that its pages are allocated on its own node.
+*/
+#define PLACE_NONE    0
+#define PLACE_COMPACT 1
+#define PLACE_SCATTER 2
+#define PLACE_LIST    3
+
+typedef struct CPU_PLACE_S
 {
-    void *retval;
-    return (ee_u8)pthread_join(res->port.thread, &retval);
+    int cpu;
+    int node;
+    int package;
+    int core;
+    int smt;  /* position among the SMT siblings of the core */
+    int rank; /* position among cpus with the same node and smt */
+} cpu_place;
+
+static int    place_policy = PLACE_NONE;
+static char * place_arg    = NULL;
+static int *  place_cpus   = NULL;
+static ee_u32 place_num    = 0;
+
+/* the C argument after C or Cp, NULL without a scan, and its cpus */
+static char *scan_arg  = NULL;
+static int * scan_cpus = NULL;
+
+/* Function: parse_cpu_list
+        Parse a list such as 0-3,8,10-11 into at most <max> cpus.
+*/
+static int
+parse_cpu_list(const char *list, int *cpus, int max)
+{
+    int n = 0;
+    while (*list)
+    {
+        char *end;
+        long  lo = strtol(list, &end, 10), hi;
+        if (end == list)
+            break;
+        hi = lo;
+        if (*end == '-')
+        {
+            list = end + 1;
+            hi   = strtol(list, &end, 10);
+            if (end == list)
+                break;
+        }
+        for (; (lo <= hi) && (n < max); lo++)
+            cpus[n++] = (int)lo;
+        list = end;
+        if (*list != ',')
+            break;
+        list++;
+    }
+    return n;
 }
-#elif USE_FORK
-static int key_id = 0;
-ee_u8
-core_start_parallel(core_results *res)
+/* Function: cpu_limits_linux
+        Lower <CPU limits> to the affinity mask, and to the effective cpuset
+   and cpu.max quotas of the cgroup v2 hierarchy of the process.
+*/
+static void
+cpu_limits_linux(cpu_limits *l)
 {
-    key_t key = 4321 + key_id;
-    key_id++;
-    res->port.pid   = fork();
-    res->port.shmid = shmget(key, 8, IPC_CREAT | 0666);
-    if (res->port.shmid < 0)
+    cpu_set_t set;
+    char      cgroup[4096], path[4096 + 64], line[4096];
+    FILE *    f;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
     {
-        ee_printf("ERROR in shmget!\n");
+        l->affinity = (ee_u32)CPU_COUNT(&set);
+        if ((l->affinity > 0) && (l->affinity < l->usable))
+            l->usable = l->affinity;
     }
-    if (res->port.pid == 0)
+    /* the cgroup v2 of the process is the line 0::<path> */
+    cgroup[0] = '\0';
+    f         = fopen("/proc/self/cgroup", "r");
+    if (f == NULL)
+        return;
+    while (fgets(line, sizeof(line), f))
     {
-        iterate(res);
-        res->port.shm = shmat(res->port.shmid, NULL, 0);
-        /* copy the validation values to the shared memory area  and quit*/
-        if (res->port.shm == (char *)-1)
+        if (strncmp(line, "0::", 3) == 0)
         {
-            ee_printf("ERROR in child shmat!\n");
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(cgroup, sizeof(cgroup), "%s", line + 3);
+            break;
         }
-        else
+    }
+    fclose(f);
+    if (cgroup[0] != '/')
+        return;
+    snprintf(path,
+             sizeof(path),
+             "%s%s/cpuset.cpus.effective",
+             CGROUP2_MOUNT,
+             cgroup);
+    f = fopen(path, "r");
+    if (f != NULL)
+    {
+        int *cpus = (int *)malloc(CPU_SETSIZE * sizeof(int));
+        if ((cpus != NULL) && fgets(line, sizeof(line), f))
+            l->cpuset = (ee_u32)parse_cpu_list(line, cpus, CPU_SETSIZE);
+        if ((l->cpuset > 0) && (l->cpuset < l->usable))
+            l->usable = l->cpuset;
+        free(cpus);
+        fclose(f);
+    }
+    /* any ancestor may hold the tightest quota */
+    for (;;)
+    {
+        char  quota[32];
+        long  period;
+        char *slash;
+        snprintf(
+            path, sizeof(path), "%s%s/cpu.max", CGROUP2_MOUNT, cgroup);
+        f = fopen(path, "r");
+        if (f != NULL)
         {
-            memcpy(res->port.shm, &(res->crc), 8);
-            shmdt(res->port.shm);
+            if ((fscanf(f, "%31s %ld", quota, &period) == 2)
+                && (strcmp(quota, "max") != 0) && (period > 0))
+            {
+                long runtime = atol(quota);
+                /* rounded down, a context on a fraction of a cpu would be
+                 * throttled within the timed region */
+                ee_u32 cpus = (ee_u32)(runtime / period);
+                if ((l->quota == 0)
+                    || (runtime * l->period < l->quota * period))
+                {
+                    l->quota  = runtime;
+                    l->period = period;
+                }
+                if (cpus < 1)
+                    cpus = 1;
+                if (cpus < l->usable)
+                    l->usable = cpus;
+            }
+            fclose(f);
         }
-        exit(0);
+        slash = strrchr(cgroup, '/');
+        if ((slash == NULL) || (cgroup[1] == '\0'))
+            break;
+        if (slash == cgroup)
+            slash++; /* keep the root */
+        *slash = '\0';
     }
-    return 1;
 }
-ee_u8
-core_stop_parallel(core_results *res)
+static int
+read_cpu_int(int cpu, const char *file, int dflt)
 {
-    int   status;
-    pid_t wpid = waitpid(res->port.pid, &status, WUNTRACED);
-    if (wpid != res->port.pid)
+    char  path[128];
+    FILE *f;
+    int   val = dflt;
+    snprintf(path,
+             sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/%s",
+             cpu,
+             file);
+    f = fopen(path, "r");
+    if (f)
     {
-        ee_printf("ERROR waiting for child.\n");
-        if (errno == ECHILD)
-            ee_printf("errno=No such child %d\n", res->port.pid);
-        if (errno == EINTR)
-            ee_printf("errno=Interrupted\n");
+        if (fscanf(f, "%d", &val) != 1)
+            val = dflt;
+        fclose(f);
+    }
+    return val;
+}
+static int
+cpu_node(int cpu)
+{
+    char           path[64];
+    DIR *          dir;
+    struct dirent *entry;
+    int            node = 0;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(path);
+    if (dir == NULL)
         return 0;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if ((strncmp(entry->d_name, "node", 4) == 0)
+            && isdigit((unsigned char)entry->d_name[4]))
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
     }
-    /* after process is done, get the values from the shared memory area */
-    res->port.shm = shmat(res->port.shmid, NULL, 0);
-    if (res->port.shm == (char *)-1)
+    closedir(dir);
+    return node;
+}
+static int
+cpu_smt(int cpu)
+{
+    char  path[128], list[256];
+    int   siblings[CPU_SETSIZE];
+    int   n = 0, i;
+    FILE *f;
+    snprintf(path,
+             sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+             cpu);
+    f = fopen(path, "r");
+    if (f)
     {
-        ee_printf("ERROR in parent shmat!\n");
-        return 0;
+        if (fgets(list, sizeof(list), f))
+            n = parse_cpu_list(list, siblings, CPU_SETSIZE);
+        fclose(f);
     }
-    memcpy(&(res->crc), res->port.shm, 8);
-    shmdt(res->port.shm);
-    return 1;
+    for (i = 0; i < n; i++)
+        if (siblings[i] == cpu)
+            return i;
+    return 0;
 }
-#elif USE_SOCKET
-static int key_id = 0;
-ee_u8
-core_start_parallel(core_results *res)
+static int
+cmp_compact(const void *pa, const void *pb)
 {
-    int bound, buffer_length = 8;
-    res->port.sa.sin_family      = AF_INET;
-    res->port.sa.sin_addr.s_addr = htonl(0x7F000001);
-    res->port.sa.sin_port        = htons(7654 + key_id);
-    key_id++;
-    res->port.pid = fork();
-    if (res->port.pid == 0)
-    { /* benchmark child */
-        iterate(res);
-        res->port.sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
-        if (-1 == res->port.sock) /* if socket failed to initialize, exit */
-        {
-            ee_printf("Error Creating Socket");
-        }
-        else
-        {
-            int bytes_sent = sendto(res->port.sock,
-                                    &(res->crc),
-                                    buffer_length,
-                                    0,
-                                    (struct sockaddr *)&(res->port.sa),
-                                    sizeof(struct sockaddr_in));
-            if (bytes_sent < 0)
-                ee_printf("Error sending packet: %s\n", strerror(errno));
-            close(res->port.sock); /* close the socket */
-        }
-        exit(0);
+    const cpu_place *a = (const cpu_place *)pa, *b = (const cpu_place *)pb;
+    if (a->node != b->node)
+        return a->node - b->node;
+    if (a->package != b->package)
+        return a->package - b->package;
+    if (a->core != b->core)
+        return a->core - b->core;
+    if (a->smt != b->smt)
+        return a->smt - b->smt;
+    return a->cpu - b->cpu;
+}
+static int
+cmp_scatter(const void *pa, const void *pb)
+{
+    const cpu_place *a = (const cpu_place *)pa, *b = (const cpu_place *)pb;
+    if (a->smt != b->smt)
+        return a->smt - b->smt;
+    if (a->rank != b->rank)
+        return a->rank - b->rank;
+    return cmp_compact(pa, pb);
+}
+/* Function: placement_build
+        Turn the placement policy into the ordered list of cpus to use.
+*/
+static void
+placement_build(void)
+{
+    cpu_set_t  allowed;
+    cpu_place *cpus;
+    int        i, j, n = 0;
+
+    if (place_policy == PLACE_NONE)
+        return;
+    place_cpus = (int *)malloc(CPU_SETSIZE * sizeof(int));
+    cpus       = (cpu_place *)calloc(CPU_SETSIZE, sizeof(cpu_place));
+    if ((place_cpus == NULL) || (cpus == NULL))
+    {
+        ee_printf("ERROR allocating cpu placement\n");
+        place_policy = PLACE_NONE;
+        free(cpus);
+        return;
+    }
+    if (place_policy == PLACE_LIST)
+    {
+        place_num = parse_cpu_list(place_arg, place_cpus, CPU_SETSIZE);
+        free(cpus);
+        return;
     }
-    /* parent process, open the socket */
-    res->port.sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    bound          = bind(res->port.sock,
-                 (struct sockaddr *)&(res->port.sa),
-                 sizeof(struct sockaddr));
-    if (bound < 0)
-        ee_printf("bind(): %s\n", strerror(errno));
-    return 1;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        CPU_ZERO(&allowed);
+    for (i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (!CPU_ISSET(i, &allowed))
+            continue;
+        cpus[n].cpu     = i;
+        cpus[n].node    = cpu_node(i);
+        cpus[n].package = read_cpu_int(i, "physical_package_id", 0);
+        cpus[n].core    = read_cpu_int(i, "core_id", i);
+        cpus[n].smt     = cpu_smt(i);
+        n++;
+    }
+    qsort(cpus, n, sizeof(cpu_place), cmp_compact);
+    if (place_policy == PLACE_SCATTER)
+    {
+        for (i = 0; i < n; i++)
+            for (j = 0; j < i; j++)
+                if ((cpus[j].node == cpus[i].node)
+                    && (cpus[j].smt == cpus[i].smt))
+                    cpus[i].rank++;
+        qsort(cpus, n, sizeof(cpu_place), cmp_scatter);
+    }
+    for (i = 0; i < n; i++)
+        place_cpus[i] = cpus[i].cpu;
+    place_num = n;
+    free(cpus);
 }
-ee_u8
-core_stop_parallel(core_results *res)
+/* Function: scan_build
+        Turn the C argument into the cpus of the scan, see <default_scan>:
+   the listed ones, or every cpu of the affinity mask for an empty list,
+   and the outlier deviation after a slash.
+*/
+static void
+scan_build(void)
 {
-    int status;
-    int fromlen = sizeof(struct sockaddr);
-    int recsize = recvfrom(res->port.sock,
-                           &(res->crc),
-                           8,
-                           0,
-                           (struct sockaddr *)&(res->port.sa),
-                           &fromlen);
-    if (recsize < 0)
-    {
-        ee_printf("Error in receive: %s\n", strerror(errno));
-        return 0;
+    cpu_set_t allowed;
+    char *    slash;
+    int       i;
+    if (scan_arg == NULL)
+        return;
+    scan_cpus = (int *)malloc(CPU_SETSIZE * sizeof(int));
+    if (scan_cpus == NULL)
+    {
+        ee_printf("ERROR allocating the cpu scan\n");
+        default_scan = SCAN_NONE;
+        return;
     }
-    pid_t wpid = waitpid(res->port.pid, &status, WUNTRACED);
-    if (wpid != res->port.pid)
+    slash = strchr(scan_arg, '/');
+    if (slash != NULL)
     {
-        ee_printf("ERROR waiting for child.\n");
-        if (errno == ECHILD)
-            ee_printf("errno=No such child %d\n", res->port.pid);
-        if (errno == EINTR)
-            ee_printf("errno=Interrupted\n");
-        return 0;
+        *slash                 = '\0';
+        default_scan_deviation = (ee_u32)strtoul(slash + 1, NULL, 10);
+    }
+    if (*scan_arg != '\0')
+        default_num_scan_cpus = (ee_u32)parse_cpu_list(
+            scan_arg, scan_cpus, CPU_SETSIZE);
+    else if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        for (i = 0; i < CPU_SETSIZE; i++)
+            if (CPU_ISSET(i, &allowed))
+                scan_cpus[default_num_scan_cpus++] = i;
+    if (default_num_scan_cpus == 0)
+    {
+        ee_printf("ERROR! No cpus to scan in %s\n", scan_arg);
+        default_scan = SCAN_NONE;
+    }
+}
+/* Function: placement_pin
+        Pin the calling thread to the cpu of placement slot <slot>, or during
+   a cpu scan to the cpu <slot> places after <default_scan_step>.
+*/
+static void
+placement_pin(ee_u32 slot)
+{
+    cpu_set_t set;
+    int       cpu;
+    if ((default_scan_step >= 0) && (default_num_scan_cpus > 0))
+        cpu = scan_cpus[(default_scan_step + slot) % default_num_scan_cpus];
+    else if (place_num > 0)
+        cpu = place_cpus[slot % place_num];
+    else
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        ee_printf("ERROR pinning to cpu %d: %s\n", cpu, strerror(errno));
+}
+/* Function: memory_node
+        Numa node the page holding <p> was allocated on, -1 if unknown.
+*/
+static int
+memory_node(void *p)
+{
+    long  page   = sysconf(_SC_PAGESIZE);
+    void *addr   = (void *)((ee_ptr_int)p & ~(ee_ptr_int)(page - 1));
+    int   status = -1;
+    if (syscall(SYS_move_pages, 0, 1UL, &addr, NULL, &status, 0) != 0)
+        return -1;
+    return status;
+}
+#endif /* HAS_AFFINITY */
+
+#if USE_POOL
+/* Variable: pool_num_workers
+        Number of workers in the work stealing pool, 0 for one per usable cpu.
+*/
+static ee_u32 pool_num_workers = 0;
+/* number of workers actually started */
+static ee_u32 pool_size = 0;
+#endif
+
+
+/* Deadline:
+        With <default_duration>, the time all contexts stop at, in
+   <portable_ticks>. Kept in a shared mapping created before any context is
+   started, so that forked children see it too.
+*/
+static CORE_TICKS *deadline_ticks = NULL;
+#if USE_FORK
+static void arena_init(void); /* results arena, see core_start_parallel */
+#elif USE_SOCKET
+static void collector_init(void); /* see core_start_parallel */
+#endif
+
+static ee_u8
+deadline_init(void)
+{
+    void *shared = mmap(NULL,
+                        sizeof(CORE_TICKS),
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS,
+                        -1,
+                        0);
+    if (shared == MAP_FAILED)
+    {
+        ee_printf("ERROR mapping deadline: %s\n", strerror(errno));
+        return 1;
+    }
+    deadline_ticks = (CORE_TICKS *)shared;
+    return 0;
+}
+static int
+deadline_passed(void)
+{
+    return portable_ticks() >= *deadline_ticks;
+}
+
+/* the S argument, NULL without a sweep */
+static char *sweep_arg = NULL;
+
+/* Function: sweep_build
+        Turn the S argument into <default_sweep>: 1, 2, 4 and so on up to
+   <default_num_contexts> for a bare S, or 1 followed by the listed numbers
+   of contexts that are larger than the previous step.
+*/
+static void
+sweep_build(void)
+{
+    char         *list = sweep_arg;
+    unsigned long n;
+    if (sweep_arg == NULL)
+        return;
+    default_sweep[0]  = 1;
+    default_num_sweep = 1;
+    if (*list == '\0')
+    {
+        for (n = 2; n < default_num_contexts; n *= 2)
+            if (default_num_sweep < MAX_SWEEP_STEPS - 1)
+                default_sweep[default_num_sweep++] = n;
+        if (default_num_contexts > 1)
+            default_sweep[default_num_sweep++] = default_num_contexts;
+        return;
+    }
+    while (*list && (default_num_sweep < MAX_SWEEP_STEPS))
+    {
+        char *end;
+        n = strtoul(list, &end, 10);
+        if (end == list)
+        {
+            ee_printf("ERROR! Unknown sweep step %s\n", list);
+            break;
+        }
+        if (n > default_sweep[default_num_sweep - 1])
+            default_sweep[default_num_sweep++] = n;
+        list = (*end == ',') ? end + 1 : end;
+    }
+    default_num_contexts = default_sweep[default_num_sweep - 1];
+}
+#endif
+
+#if (SEED_METHOD == SEED_ARG)
+/* Function: parse_size
+        Parse a size in bytes, optionally followed by K, M or G, and set
+   <end> past it.
+*/
+static unsigned long
+parse_size(char *s, char **end)
+{
+    unsigned long n = strtoul(s, end, 10);
+    if (*end == s)
+        return 0;
+    if (**end == 'K')
+        n *= 1024;
+    else if (**end == 'M')
+        n *= 1024 * 1024;
+    else if (**end == 'G')
+        n *= 1024 * 1024 * 1024;
+    if ((**end == 'K') || (**end == 'M') || (**end == 'G'))
+        (*end)++;
+    return n;
+}
+/* Function: size_sweep_parse
+        Fill <default_size_sweep> from the Z argument: <SIZE_SWEEP_SIZES> for
+   a bare Z, or a list of sizes in bytes, each optionally followed by K or M.
+*/
+static void
+size_sweep_parse(char *list)
+{
+    static const ee_u32 sizes[] = { SIZE_SWEEP_SIZES };
+    ee_u32              i;
+    default_num_size_sweep = 0;
+    if (*list == '\0')
+    {
+        for (i = 0; (i < sizeof(sizes) / sizeof(sizes[0]))
+                    && (i < MAX_SWEEP_STEPS);
+             i++)
+            default_size_sweep[default_num_size_sweep++] = sizes[i];
+        return;
+    }
+    while (*list && (default_num_size_sweep < MAX_SWEEP_STEPS))
+    {
+        char         *end;
+        unsigned long n = parse_size(list, &end);
+        if (end == list)
+        {
+            ee_printf("ERROR! Unknown data size %s\n", list);
+            break;
+        }
+        default_size_sweep[default_num_size_sweep++] = n;
+        list = (*end == ',') ? end + 1 : end;
+    }
+}
+/* Function: portable_arg
+        Parse one argument directed to the portable part.
+
+        Valid arguments:
+        M<n> - run <n> contexts, M0 for one context per usable cpu.
+        W<n> - with <USE_POOL>, run the contexts on a pool of <n> workers.
+        P<policy> - pin contexts to cpus, see <Placement>.
+        C[p][<list>][/<pct>] - scan cpus, see <default_scan>.
+        D<n> - run all contexts for <n> seconds, see <default_duration>.
+        T<n> - repeat the timed run <n> times, see <default_num_trials>.
+        O<format> - report as json, csv or text, see <default_output_format>.
+        S[<list>] - sweep the number of contexts, see <default_sweep>.
+        Z[<list>] - sweep the data size, see <default_size_sweep>.
+        A<list> - place the data of the contexts, see <memblock_parse>.
+        L<size> - scatter the list over <size> bytes, see
+   <default_list_footprint>.
+        N<items> - build lists of <items> items, see <default_list_items>.
+
+        Returns:
+        1 if the argument was consumed, 0 if it belongs to coremark main.
+*/
+static int
+portable_arg(char *arg)
+{
+    ee_s32        val;
+    unsigned long size;
+    char *        end;
+    switch (arg[0])
+    {
+        case 'T':
+            val = parseval(arg + 1);
+            if (val > 0)
+                default_num_trials = val;
+            return 1;
+        case 'Z':
+            size_sweep_parse(arg + 1);
+            return 1;
+        case 'A':
+            memblock_parse(arg + 1);
+            return 1;
+        case 'N':
+#if LIST_WIDE
+            default_list_items = parse_size(arg + 1, &end);
+            if ((end == arg + 1) || (*end != '\0'))
+                ee_printf("ERROR! Unknown list length %s\n", arg + 1);
+#else
+            ee_printf("ERROR! A list length needs LIST_WIDE\n");
+#endif
+            return 1;
+        case 'L':
+            size = parse_size(arg + 1, &end);
+            if ((end == arg + 1) || (*end != '\0'))
+                ee_printf("ERROR! Unknown list footprint %s\n", arg + 1);
+            else if (size > 0xffffffffUL)
+                ee_printf("ERROR! A list footprint of %s is 4G or more\n",
+                          arg + 1);
+            else
+                default_list_footprint = (ee_u32)size;
+            return 1;
+#if OUTPUT_RECORD
+        case 'O':
+            if (strcmp(arg + 1, "json") == 0)
+                default_output_format = OUTPUT_JSON;
+            else if (strcmp(arg + 1, "csv") == 0)
+                default_output_format = OUTPUT_CSV;
+            else if (strcmp(arg + 1, "text") == 0)
+                default_output_format = OUTPUT_TEXT;
+            else
+                ee_printf("ERROR! Unknown output format %s\n", arg + 1);
+            return 1;
+#endif
+#if (MULTITHREAD > 1)
+        case 'M':
+            /* any number of contexts may be requested, M0 means one context
+             * per usable cpu */
+            val = parseval(arg + 1);
+            if (val > 0)
+                default_num_contexts = val;
+            else
+                default_num_contexts = portable_num_cpus();
+            contexts_given = 1;
+            return 1;
+#if USE_POOL
+        case 'W':
+            val = parseval(arg + 1);
+            if (val > 0)
+                pool_num_workers = val;
+            return 1;
+#endif
+        case 'D':
+            val = parseval(arg + 1);
+            if (val > 0)
+                default_duration = val;
+            return 1;
+        case 'S':
+            sweep_arg = arg + 1;
+            return 1;
+#if HAS_AFFINITY
+        case 'P':
+            place_arg = arg + 1;
+            if (strcmp(place_arg, "compact") == 0)
+                place_policy = PLACE_COMPACT;
+            else if (strcmp(place_arg, "scatter") == 0)
+                place_policy = PLACE_SCATTER;
+            else if (isdigit((unsigned char)place_arg[0]))
+                place_policy = PLACE_LIST;
+            else
+                ee_printf("ERROR! Unknown placement %s\n", place_arg);
+            return 1;
+        case 'C':
+            default_scan = SCAN_SERIAL;
+            scan_arg     = arg + 1;
+            if (*scan_arg == 'p')
+            {
+                default_scan = SCAN_PARALLEL;
+                scan_arg++;
+            }
+            return 1;
+#endif
+#endif
+        default:
+            return 0;
+    }
+}
+#endif
+
+/* Function: portable_init
+        Target specific initialization code
+        Test for some common mistakes.
+*/
+void
+portable_init(core_portable *p, int *argc, char *argv[])
+{
+#if PRINT_ARGS
+    int i;
+    for (i = 0; i < *argc; i++)
+    {
+        ee_printf("Arg[%d]=%s\n", i, argv[i]);
+    }
+#endif
+
+    (void)argc; // prevent unused warning
+    (void)argv; // prevent unused warning
+
+    timer_calibrate();
+    GETMYTIME(&epoch_time_val);
+    if (sizeof(ee_ptr_int) != sizeof(ee_u8 *))
+    {
+        ee_printf(
+            "ERROR! Please define ee_ptr_int to a type that holds a "
+            "pointer!\n");
+    }
+    if (sizeof(ee_u32) != 4)
+    {
+        ee_printf("ERROR! Please define ee_u32 to a 32b unsigned type!\n");
+    }
+#if (MAIN_HAS_NOARGC && (SEED_METHOD == SEED_ARG))
+    ee_printf(
+        "ERROR! Main has no argc, but SEED_METHOD defined to SEED_ARG!\n");
+#endif
+
+#if (SEED_METHOD == SEED_ARG)
+    int nargs = *argc, i;
+    while ((nargs > 1) && portable_arg(argv[1]))
+    {
+        /* Shift args since first arg is directed to the portable part and not
+         * to coremark main */
+        --nargs;
+        for (i = 1; i < nargs; i++)
+            argv[i] = argv[i + 1];
+        *argc = nargs;
+    }
+#endif /* sample of potential platform specific init via command line, reset \
+          the number of contexts being used if first argument is M<n>*/
+#if (MULTITHREAD > 1)
+#if CONTEXTS_FROM_CPUS
+    if (!contexts_given)
+#if USE_POOL
+        /* workers need contexts waiting in their deques to steal from */
+        default_num_contexts
+            = (pool_num_workers ? pool_num_workers : portable_num_cpus())
+              * POOL_CONTEXTS_PER_WORKER;
+#else
+        default_num_contexts = portable_num_cpus();
+#endif
+#if (MEM_METHOD == MEM_STACK) && !CONTEXT_STACK
+    if (default_num_contexts > MULTITHREAD)
+        default_num_contexts = MULTITHREAD;
+#endif
+#endif
+    sweep_build();
+#if HAS_AFFINITY
+    placement_build();
+    scan_build();
+#endif
+    if ((default_duration > 0) && deadline_init())
+        default_duration = 0;
+#if USE_FORK
+    arena_init();
+#elif USE_SOCKET
+    collector_init();
+#endif
+#if (USE_FORK || USE_SOCKET)
+    memblock_share();
+#endif
+#endif
+#if (MULTITHREAD > 1)
+    p->slot = 0;
+#endif
+    p->portable_id = 1;
+}
+/* Function: portable_fini
+        Target specific final code
+*/
+void
+portable_fini(core_portable *p)
+{
+    p->portable_id = 0;
+    /* a JSON or CSV report is nothing but the result record */
+    if (default_output_format != OUTPUT_TEXT)
+        return;
+#if USE_TSC
+    if (tsc_usable)
+        ee_printf("Timer            : TSC at %f GHz\n", 1.0 / tsc_ns_per_count);
+    else
+        ee_printf("Timer            : CLOCK_MONOTONIC_RAW, TSC not invariant\n");
+#elif USE_MONOTONIC_RAW
+    ee_printf("Timer            : CLOCK_MONOTONIC_RAW\n");
+#endif
+#if (USE_TSC || USE_MONOTONIC_RAW)
+    ee_printf("Timer overhead   : %lu ticks\n", (long unsigned)timer_overhead);
+#endif
+#if (MEM_METHOD == MEM_MALLOC)
+    memblock_report();
+#endif
+#if (MULTITHREAD > 1) && !PACKED_RESULTS && defined(__GNUC__)
+    ee_printf("Context results  : %lu bytes, cache line aligned\n",
+              (long unsigned)sizeof(core_results));
+#elif (MULTITHREAD > 1)
+    ee_printf("Context results  : %lu bytes, packed\n",
+              (long unsigned)sizeof(core_results));
+#endif
+#if (MULTITHREAD > 1) && USE_POOL
+    ee_printf("Pool workers     : %u\n", pool_size);
+#endif
+#if (MULTITHREAD > 1)
+    cpu_limits_report();
+#endif
+#if (MULTITHREAD > 1) && HAS_AFFINITY
+    if (place_policy != PLACE_NONE)
+        ee_printf("Placement        : %s (%u cpus)\n", place_arg, place_num);
+#endif
+}
+
+#if (MULTITHREAD > 1)
+
+/* Start barrier:
+        Every backend parks its contexts on a pair of pipes once they have been
+   created. Each context writes one byte to the ready pipe and then blocks
+   reading the go pipe. <core_wait_parallel> collects the ready bytes, and
+   <core_release_parallel> closes the write end of the go pipe, which wakes
+   all contexts at once with end of file. Pipes work the same for threads
+   and forked children, so thread or process creation is kept out of the
+   timed region for all backends. A context whose thread or process could
+   not be created is taken back with <gate_unarm>, so that the barrier only
+   waits for contexts that exist.
+*/
+static int    ready_pipe[2] = { -1, -1 };
+static int    go_pipe[2]    = { -1, -1 };
+static ee_u32 gate_started  = 0;
+static ee_u32 gate_stopped  = 0;
+
+static ee_u8
+gate_arm(core_results *res)
+{
+    if (gate_started == 0)
+    {
+        if ((pipe(ready_pipe) != 0) || (pipe(go_pipe) != 0))
+        {
+            ee_printf("ERROR creating start barrier: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    if (res != NULL)
+        res->port.slot = gate_started;
+    gate_started++;
+    return 0;
+}
+static void
+gate_unarm(void)
+{
+    if (--gate_started > 0)
+        return;
+    close(ready_pipe[0]);
+    close(ready_pipe[1]);
+    close(go_pipe[0]);
+    close(go_pipe[1]);
+}
+static void
+gate_park(int is_child)
+{
+    char token = 'r';
+    if (is_child)
+    { /* children must drop their copy of the go pipe or never see EOF */
+        close(go_pipe[1]);
+        close(ready_pipe[0]);
+    }
+    if (write(ready_pipe[1], &token, 1) != 1)
+        ee_printf("ERROR signalling ready: %s\n", strerror(errno));
+    while (read(go_pipe[0], &token, 1) > 0)
+        ;
+}
+static void
+gate_done(void)
+{
+    if (++gate_stopped < gate_started)
+        return;
+    close(ready_pipe[0]);
+    close(ready_pipe[1]);
+    close(go_pipe[0]);
+    gate_started = gate_stopped = 0;
+}
+
+/* Function: core_wait_parallel
+        Block until every context started with <core_start_parallel> is
+   parked on the start barrier.
+*/
+ee_u8
+core_wait_parallel(void)
+{
+    ee_u32 ready = 0;
+    char   token;
+    while (ready < gate_started)
+    {
+        if (read(ready_pipe[0], &token, 1) != 1)
+        {
+            ee_printf("ERROR waiting for contexts: %s\n", strerror(errno));
+            return 1;
+        }
+        ready++;
+    }
+    return 0;
+}
+/* Function: core_release_parallel
+        Release all parked contexts. Call right after <start_time>.
+*/
+ee_u8
+core_release_parallel(void)
+{
+    if (default_duration > 0)
+        *deadline_ticks = portable_start_ticks()
+                          + (CORE_TICKS)default_duration * EE_TICKS_PER_SEC;
+    close(go_pipe[1]);
+    go_pipe[1] = -1;
+    return 0;
+}
+
+/* Function: init_parallel
+        Initialize the data of a context from the thread or process that runs
+   it, and record where it runs and where its data was allocated.
+*/
+static ee_u8
+init_parallel(core_results *res)
+{
+    if (core_init_context(res))
+    {
+        /* nothing to run, the CRCs will fail validation */
+        res->iterations = 0;
+        iterate(res);
+        return 1;
+    }
+#if HAS_AFFINITY
+    res->cpu      = sched_getcpu();
+    res->mem_node = memory_node(res->memblock[0]);
+#endif
+    return 0;
+}
+#if (USE_FORK || USE_SOCKET) && PREFAULT_CHILDREN
+/* stack touched by <prefault_stack>, well above what the benchmark uses */
+#define PREFAULT_STACK_SIZE (64 * 1024)
+
+/* Function: prefault_memblock
+        Allocate the memory block of a forked child with every page faulted
+   in, so that the pages <core_init_context> leaves untouched, like the
+   matrix results, are already there once the child is timed. If that fails
+   the block is left to <core_init_context>.
+*/
+static void
+prefault_memblock(core_results *res)
+{
+#if (MEM_METHOD == MEM_MALLOC)
+    if (res->memblock[0] != NULL)
+        return;
+    res->memblock[0] = memblock_map(core_context_size(res), res->port.slot, 1);
+#else
+    (void)res;
+#endif
+}
+/* Function: prefault_stack
+        Write to the stack below the caller, so that the frames of the timed
+   region land on pages the child already owns.
+*/
+static void __attribute__((noinline))
+prefault_stack(void)
+{
+    volatile ee_u8 stack[PREFAULT_STACK_SIZE];
+    size_t         i;
+    for (i = 0; i < sizeof(stack); i += 512)
+        stack[i] = 0;
+}
+#endif
+#if !USE_POOL
+/* Function: iterate_until_deadline
+        Run iterations until the deadline has passed, at least one, and count
+   them in <res->iterations>.
+*/
+static void
+iterate_until_deadline(core_results *res)
+{
+    ee_u32 done = 0;
+    do
+    {
+        iterate_batch(res, done, 1);
+        done++;
+    } while (!deadline_passed());
+    res->iterations = done;
+}
+/* Function: run_parallel
+        Body of a parallel context: get placed, initialize the data, park on
+   the start barrier, then run the benchmark and record when this context
+   started and stopped.
+*/
+static void
+run_parallel(core_results *res, int is_child)
+{
+    ee_u8 failed;
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+    /* the data of the context lives on the stack of its thread or process */
+    ee_u8 stack_memblock[TOTAL_DATA_SIZE];
+    res->memblock[0] = stack_memblock;
+#endif
+#if PERF_COUNTERS
+    core_counters begin, end;
+#endif
+#if HAS_AFFINITY
+    placement_pin(res->port.slot);
+#endif
+#if (USE_FORK || USE_SOCKET) && PREFAULT_CHILDREN
+    if (is_child)
+        prefault_memblock(res);
+#endif
+    failed = init_parallel(res);
+#if (USE_FORK || USE_SOCKET) && PREFAULT_CHILDREN
+    if (is_child)
+    { /* best effort, unprivileged children usually cannot lock */
+        prefault_stack();
+        mlockall(MCL_CURRENT);
+    }
+#endif
+#if PERF_COUNTERS
+    perf_open();
+#endif
+    gate_park(is_child);
+    res->start_ticks = portable_ticks();
+#if PERF_COUNTERS
+    portable_counters_read(&begin);
+#endif
+    if (!failed && (default_duration > 0))
+        iterate_until_deadline(res);
+    else if (!failed)
+        iterate(res);
+#if PERF_COUNTERS
+    portable_counters_read(&end);
+    counters_reset(&res->counters);
+    counters_add(&res->counters, &begin, &end);
+    perf_close();
+#endif
+    res->stop_ticks = portable_ticks();
+}
+#endif
+/* Function: rebase_parallel
+        Make the per context ticks relative to <start_time>.
+*/
+static void
+rebase_parallel(core_results *res)
+{
+    CORE_TICKS start = portable_start_ticks();
+    res->start_ticks -= start;
+    res->stop_ticks -= start;
+}
+
+#if (USE_FORK || USE_SOCKET)
+/* Outputs a child process hands back to the parent */
+typedef struct CHILD_RESULTS_S
+{
+    ee_u16     crc;
+    ee_u16     crclist;
+    ee_u16     crcmatrix;
+    ee_u16     crcstate;
+    ee_u32     iterations;
+    CORE_TICKS start_ticks;
+    CORE_TICKS stop_ticks;
+    ee_s32     cpu;
+    ee_s32     mem_node;
+#if LATENCY_HISTOGRAM
+    core_latency latency;
+#endif
+#if KERNEL_PROFILE
+    core_profile profile;
+#endif
+#if PERF_COUNTERS
+    core_counters counters;
+#endif
+} child_results;
+
+static void
+child_results_pack(child_results *to, core_results *from)
+{
+    to->crc         = from->crc;
+    to->crclist     = from->crclist;
+    to->crcmatrix   = from->crcmatrix;
+    to->crcstate    = from->crcstate;
+    to->iterations  = from->iterations;
+    to->start_ticks = from->start_ticks;
+    to->stop_ticks  = from->stop_ticks;
+    to->cpu         = from->cpu;
+    to->mem_node    = from->mem_node;
+#if LATENCY_HISTOGRAM
+    to->latency = from->latency;
+#endif
+#if KERNEL_PROFILE
+    to->profile = from->profile;
+#endif
+#if PERF_COUNTERS
+    to->counters = from->counters;
+#endif
+}
+static void
+child_results_unpack(core_results *to, child_results *from)
+{
+    to->crc         = from->crc;
+    to->crclist     = from->crclist;
+    to->crcmatrix   = from->crcmatrix;
+    to->crcstate    = from->crcstate;
+    to->iterations  = from->iterations;
+    to->start_ticks = from->start_ticks;
+    to->stop_ticks  = from->stop_ticks;
+    to->cpu         = from->cpu;
+    to->mem_node    = from->mem_node;
+#if LATENCY_HISTOGRAM
+    to->latency = from->latency;
+#endif
+#if KERNEL_PROFILE
+    to->profile = from->profile;
+#endif
+#if PERF_COUNTERS
+    to->counters = from->counters;
+#endif
+}
+/* Function: child_results_discard
+        Clear the outputs of a context whose child failed, so that what an
+   earlier trial left there is never taken for its results.
+*/
+static void
+child_results_discard(core_results *res)
+{
+    res->crc        = 0;
+    res->crclist    = 0;
+    res->crcmatrix  = 0;
+    res->crcstate   = 0;
+    res->iterations = 0;
+}
+#endif
+
+/* Function: core_start_parallel
+        Start benchmarking in a parallel context.
+
+        Three implementations are provided, one using pthreads, one using fork
+   and shared mem, and one using fork and sockets. Other implementations using
+   MCAPI or other standards can easily be devised.
+
+        The context is parked on the start barrier until
+   <core_release_parallel> is called.
+*/
+/* Function: core_stop_parallel
+        Stop a parallel context execution of coremark, and gather the results.
+
+        Three implementations are provided, one using pthreads, one using fork
+   and shared mem, and one using fork and sockets. Other implementations using
+   MCAPI or other standards can easily be devised.
+
+        Returns:
+        0 once the results of the context are gathered, nonzero if the context
+   failed. The results of a failed forked context are cleared.
+*/
+#if USE_PTHREAD
+static void *
+thread_parallel(void *pres)
+{
+    run_parallel((core_results *)pres, 0);
+    return NULL;
+}
+ee_u8
+core_start_parallel(core_results *res)
+{
+    int err;
+    if (gate_arm(res))
+        return 1;
+    err = pthread_create(
+        &(res->port.thread), NULL, thread_parallel, (void *)res);
+    if (err != 0)
+    {
+        ee_printf("ERROR creating thread: %s\n", strerror(err));
+        gate_unarm();
+        return 1;
+    }
+    return 0;
+}
+ee_u8
+core_stop_parallel(core_results *res)
+{
+    void *retval;
+    ee_u8 err = (ee_u8)pthread_join(res->port.thread, &retval);
+    gate_done();
+    rebase_parallel(res);
+    return err;
+}
+#elif USE_FORK
+/* Results arena:
+        One anonymous shared mapping with a slot per context, created by
+   <portable_init> once <default_num_contexts> is final, so before any fork.
+   A child writes its results to the slot of its start order and sets the
+   done flag last, the parent reads them back after waitpid. Slots are padded
+   to whole cache lines, so children finishing at the same time never write
+   to the same line. The mapping goes away with the last process that has it
+   mapped.
+*/
+typedef struct CHILD_SLOT_S
+{
+    child_results results;
+    ee_u32        done;
+} child_slot;
+
+#define CHILD_SLOT_SIZE                                   \
+    ((sizeof(child_slot) + CACHE_LINE_SIZE - 1)           \
+     & ~((size_t)CACHE_LINE_SIZE - 1))
+
+static ee_u8 *arena       = NULL;
+static ee_u32 arena_slots = 0;
+
+static child_slot *
+arena_slot(ee_u32 slot)
+{
+    return (child_slot *)(arena + (size_t)slot * CHILD_SLOT_SIZE);
+}
+static void
+arena_init(void)
+{
+    void *shared = mmap(NULL,
+                        CHILD_SLOT_SIZE * default_num_contexts,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS,
+                        -1,
+                        0);
+    if (shared == MAP_FAILED)
+    {
+        ee_printf("ERROR mapping results arena: %s\n", strerror(errno));
+        return;
+    }
+    arena       = (ee_u8 *)shared;
+    arena_slots = default_num_contexts;
+}
+ee_u8
+core_start_parallel(core_results *res)
+{
+    child_slot *slot;
+    if (gate_arm(res))
+        return 1;
+    if (res->port.slot >= arena_slots)
+    {
+        ee_printf("ERROR no results slot for context %u\n", res->port.slot);
+        gate_unarm();
+        return 1;
+    }
+    slot       = arena_slot(res->port.slot);
+    slot->done = 0;
+    fflush(stdout); /* or the children print it again */
+    res->port.pid = fork();
+    if (res->port.pid < 0)
+    {
+        ee_printf("ERROR in fork: %s\n", strerror(errno));
+        gate_unarm();
+        return 1;
+    }
+    if (res->port.pid == 0)
+    {
+        run_parallel(res, 1);
+        /* copy the validation values to the results arena and quit */
+        child_results_pack(&slot->results, res);
+        slot->done = 1;
+        exit(0);
+    }
+    return 0;
+}
+ee_u8
+core_stop_parallel(core_results *res)
+{
+    int         status;
+    child_slot *slot = arena_slot(res->port.slot);
+    pid_t       wpid = waitpid(res->port.pid, &status, WUNTRACED);
+    /* a failed context still counts as stopped for the start barrier */
+    gate_done();
+    if (wpid != res->port.pid)
+    {
+        ee_printf("ERROR waiting for child.\n");
+        if (errno == ECHILD)
+            ee_printf("errno=No such child %d\n", res->port.pid);
+        if (errno == EINTR)
+            ee_printf("errno=Interrupted\n");
+        child_results_discard(res);
+        return 1;
+    }
+    /* after process is done, get the values from its slot */
+    if (!slot->done)
+    {
+        if (WIFSIGNALED(status))
+            ee_printf("ERROR child %d of context %u killed by signal %d\n",
+                      res->port.pid,
+                      res->port.slot,
+                      WTERMSIG(status));
+        else
+            ee_printf("ERROR child %d of context %u exited without results "
+                      "(status %d)\n",
+                      res->port.pid,
+                      res->port.slot,
+                      WEXITSTATUS(status));
+        child_results_discard(res);
+        return 1;
+    }
+    child_results_unpack(res, &slot->results);
+    rebase_parallel(res);
+    return 0;
+}
+#elif USE_SOCKET
+/* Collector:
+        One AF_UNIX datagram socket pair, created by <portable_init> before any
+   fork. Children send their results tagged with their start order on the
+   second socket, the parent reads the first one through epoll. The first
+   <core_stop_parallel> of a run gathers the results of all contexts in the
+   order they arrive, the following calls only pick up their own entry.
+
+        While waiting, the parent reaps children every second. A child that
+   exits without having sent results is reported as failed, and with
+   <COLLECT_TIMEOUT_SECS> the children still running are killed once no
+   results arrived for that long.
+*/
+typedef struct CHILD_MESSAGE_S
+{
+    ee_u32        slot;
+    child_results results;
+} child_message;
+
+#define COLLECT_PENDING 0
+#define COLLECT_DONE    1
+#define COLLECT_FAILED  2
+#define COLLECT_TIMEOUT 3
+
+typedef struct COLLECT_ENTRY_S
+{
+    child_results results;
+    pid_t         pid;
+    int           status; /* wait status, once reaped */
+    ee_u8         reaped;
+    ee_u8         state;
+} collect_entry;
+
+static int            collect_sock[2] = { -1, -1 };
+static int            collect_epoll   = -1;
+static collect_entry *collect_inbox   = NULL;
+static ee_u32         collect_slots   = 0;
+/* contexts started whose results have not been gathered yet */
+static ee_u32 collect_pending = 0;
+
+static void
+collector_init(void)
+{
+    struct epoll_event ev;
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, collect_sock) != 0)
+    {
+        ee_printf("ERROR creating results collector: %s\n", strerror(errno));
+        return;
+    }
+    collect_epoll = epoll_create1(0);
+    ev.events     = EPOLLIN;
+    ev.data.fd    = collect_sock[0];
+    if ((collect_epoll < 0)
+        || (epoll_ctl(collect_epoll, EPOLL_CTL_ADD, collect_sock[0], &ev)
+            != 0))
+    {
+        ee_printf("ERROR polling results collector: %s\n", strerror(errno));
+        return;
+    }
+    collect_inbox = (collect_entry *)malloc(default_num_contexts
+                                            * sizeof(collect_entry));
+    if (collect_inbox == NULL)
+    {
+        ee_printf("ERROR allocating results collector\n");
+        return;
+    }
+    collect_slots = default_num_contexts;
+}
+/* read all results already queued on the collector */
+static void
+collect_receive(void)
+{
+    child_message msg;
+    ssize_t       got;
+    while ((got = recv(collect_sock[0], &msg, sizeof(msg), MSG_DONTWAIT)) > 0)
+    {
+        collect_entry *e;
+        if ((got != sizeof(msg)) || (msg.slot >= collect_slots)
+            || (collect_inbox[msg.slot].state != COLLECT_PENDING))
+        {
+            ee_printf("ERROR discarding unexpected results message\n");
+            continue;
+        }
+        e          = &collect_inbox[msg.slot];
+        e->results = msg.results;
+        e->state   = COLLECT_DONE;
+        collect_pending--;
+    }
+}
+/* reap children that exited, and fail those that did so without results */
+static void
+collect_reap(void)
+{
+    ee_u32 i;
+    for (i = 0; i < gate_started; i++)
+    {
+        collect_entry *e = &collect_inbox[i];
+        if (!e->reaped && (waitpid(e->pid, &e->status, WNOHANG) == e->pid))
+            e->reaped = 1;
+    }
+    /* a reaped child has queued anything it sent before exiting */
+    collect_receive();
+    for (i = 0; i < gate_started; i++)
+    {
+        collect_entry *e = &collect_inbox[i];
+        if (e->reaped && (e->state == COLLECT_PENDING))
+        {
+            e->state = COLLECT_FAILED;
+            collect_pending--;
+        }
+    }
+}
+static void
+collect_kill(void)
+{
+    ee_u32 i;
+    for (i = 0; i < gate_started; i++)
+    {
+        collect_entry *e = &collect_inbox[i];
+        if (e->state != COLLECT_PENDING)
+            continue;
+        kill(e->pid, SIGKILL);
+        if (waitpid(e->pid, &e->status, 0) == e->pid)
+            e->reaped = 1;
+        e->state = COLLECT_TIMEOUT;
+        collect_pending--;
+    }
+    /* drop whatever the killed children managed to send */
+    collect_receive();
+}
+static void
+collect_gather(void)
+{
+    struct epoll_event ev;
+#if (COLLECT_TIMEOUT_SECS > 0)
+    ee_u32 idle = 0; /* seconds without results */
+#endif
+    while (collect_pending > 0)
+    {
+        int n = epoll_wait(collect_epoll, &ev, 1, 1000);
+        if (n > 0)
+        {
+            collect_receive();
+#if (COLLECT_TIMEOUT_SECS > 0)
+            idle = 0;
+#endif
+            continue;
+        }
+        if ((n < 0) && (errno != EINTR))
+        {
+            ee_printf("ERROR waiting for results: %s\n", strerror(errno));
+            collect_kill();
+            return;
+        }
+        collect_reap();
+#if (COLLECT_TIMEOUT_SECS > 0)
+        if (++idle >= COLLECT_TIMEOUT_SECS)
+            collect_kill();
+#endif
+    }
+}
+ee_u8
+core_start_parallel(core_results *res)
+{
+    if (gate_arm(res))
+        return 1;
+    if (res->port.slot >= collect_slots)
+    {
+        ee_printf("ERROR no results slot for context %u\n", res->port.slot);
+        gate_unarm();
+        return 1;
+    }
+    fflush(stdout); /* or the children print it again */
+    res->port.pid = fork();
+    if (res->port.pid < 0)
+    {
+        ee_printf("ERROR in fork: %s\n", strerror(errno));
+        gate_unarm();
+        return 1;
+    }
+    if (res->port.pid == 0)
+    { /* benchmark child */
+        child_message out;
+        run_parallel(res, 1);
+        out.slot = res->port.slot;
+        child_results_pack(&out.results, res);
+        if (send(collect_sock[1], &out, sizeof(out), 0) < 0)
+            ee_printf("Error sending results: %s\n", strerror(errno));
+        exit(0);
+    }
+    collect_inbox[res->port.slot].pid    = res->port.pid;
+    collect_inbox[res->port.slot].reaped = 0;
+    collect_inbox[res->port.slot].state  = COLLECT_PENDING;
+    collect_pending++;
+    return 0;
+}
+ee_u8
+core_stop_parallel(core_results *res)
+{
+    collect_entry *e = &collect_inbox[res->port.slot];
+    if (collect_pending > 0)
+        collect_gather();
+    /* a failed context still counts as stopped for the start barrier */
+    gate_done();
+    if (!e->reaped && (waitpid(e->pid, &e->status, WUNTRACED) != e->pid))
+    {
+        ee_printf("ERROR waiting for child.\n");
+        if (errno == ECHILD)
+            ee_printf("errno=No such child %d\n", e->pid);
+        if (errno == EINTR)
+            ee_printf("errno=Interrupted\n");
+        child_results_discard(res);
+        return 1;
+    }
+    e->reaped = 1;
+    if (e->state == COLLECT_TIMEOUT)
+    {
+        ee_printf("ERROR context %u timed out, child %d killed\n",
+                  res->port.slot,
+                  e->pid);
+        child_results_discard(res);
+        return 1;
+    }
+    if (e->state != COLLECT_DONE)
+    {
+        if (WIFSIGNALED(e->status))
+            ee_printf("ERROR child %d of context %u killed by signal %d\n",
+                      e->pid,
+                      res->port.slot,
+                      WTERMSIG(e->status));
+        else
+            ee_printf("ERROR child %d of context %u exited without results "
+                      "(status %d)\n",
+                      e->pid,
+                      res->port.slot,
+                      WEXITSTATUS(e->status));
+        child_results_discard(res);
+        return 1;
+    }
+    child_results_unpack(res, &e->results);
+    rebase_parallel(res);
+    return 0;
+}
+#elif USE_POOL
+/* Work stealing pool:
+        Contexts are dealt round robin to the deques of a fixed pool of
+   workers. A worker pops a context from the bottom of its own deque, runs
+   <POOL_BATCH> iterations on it with <iterate_batch> and pushes it back, so
+   it keeps working on the same context while it has one. A worker with an
+   empty deque steals a context from the top of a peer's deque, and retires
+   once all deques are empty.
+
+        A context is always either in exactly one deque or being run by
+   exactly one worker, so its batches run in order and its CRCs are the same
+   as with a thread per context. Stealing thus only takes effect with more
+   contexts than workers: a worker that ran out of contexts takes over those
+   still waiting in the deque of a slower peer. By default there are
+   <POOL_CONTEXTS_PER_WORKER> contexts per worker. With <default_duration> a
+   worker takes its own contexts from the top instead, in turn, until the
+   deadline.
+*/
+typedef struct POOL_WORKER_S
+{
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    core_results ** deque; /* circular, room for every context */
+    ee_u32          top;   /* steal end */
+    ee_u32          count;
+} pool_worker;
+
+static pool_worker *pool         = NULL;
+static ee_u32       pool_dealt   = 0;
+static ee_u32       pool_deque_n = 0;
+/* workers whose thread was created, the only ones to join */
+static ee_u32 pool_created = 0;
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+/* workers keep the data of the contexts dealt to them on their stack, so a
+ * worker only returns once no worker can still run one of its contexts */
+static pthread_mutex_t pool_retire_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  pool_retire_cond = PTHREAD_COND_INITIALIZER;
+static ee_u32          pool_running     = 0;
+
+static void
+pool_retire(void)
+{
+    pthread_mutex_lock(&pool_retire_lock);
+    if (--pool_running == 0)
+        pthread_cond_broadcast(&pool_retire_cond);
+    while (pool_running > 0)
+        pthread_cond_wait(&pool_retire_cond, &pool_retire_lock);
+    pthread_mutex_unlock(&pool_retire_lock);
+}
+#endif
+
+static void
+pool_push(pool_worker *w, core_results *res)
+{
+    pthread_mutex_lock(&w->lock);
+    w->deque[(w->top + w->count) % pool_deque_n] = res;
+    w->count++;
+    pthread_mutex_unlock(&w->lock);
+}
+static core_results *
+pool_pop(pool_worker *w)
+{
+    core_results *res = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->count > 0)
+    {
+        w->count--;
+        res = w->deque[(w->top + w->count) % pool_deque_n];
+    }
+    pthread_mutex_unlock(&w->lock);
+    return res;
+}
+static core_results *
+pool_steal(pool_worker *w)
+{
+    core_results *res = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->count > 0)
+    {
+        res    = w->deque[w->top];
+        w->top = (w->top + 1) % pool_deque_n;
+        w->count--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return res;
+}
+static core_results *
+pool_take(pool_worker *w)
+{
+    ee_u32        self = (ee_u32)(w - pool), i;
+    core_results *res;
+    /* with a deadline, rotate through own contexts so that all progress */
+    res = (default_duration > 0) ? pool_steal(w) : pool_pop(w);
+    for (i = 1; (res == NULL) && (i < pool_size); i++)
+        res = pool_steal(&pool[(self + i) % pool_size]);
+    return res;
+}
+/* Function: pool_batch
+        Number of iterations to run next on a context, 0 once it is done.
+*/
+static ee_u32
+pool_batch(core_results *res)
+{
+    ee_u32 left;
+    if (default_duration > 0)
+    {
+        if (!deadline_passed())
+            return POOL_BATCH;
+        /* every context runs its first iteration, for validation */
+        return (res->port.done == 0) ? 1 : 0;
+    }
+    left = res->iterations - res->port.done;
+    return (left < POOL_BATCH) ? left : POOL_BATCH;
+}
+static void *
+pool_worker_run(void *pw)
+{
+    pool_worker * w = (pool_worker *)pw;
+    core_results *res;
+    ee_u32        i;
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+    ee_u8 stack_memblock[(w->count ? w->count : 1) * TOTAL_DATA_SIZE];
+#endif
+#if HAS_AFFINITY
+    placement_pin((ee_u32)(w - pool));
+#endif
+    /* first touch the data of the contexts dealt to this worker */
+    for (i = 0; i < w->count; i++)
+    {
+        res = w->deque[(w->top + i) % pool_deque_n];
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+        res->memblock[0] = stack_memblock + i * TOTAL_DATA_SIZE;
+#endif
+        init_parallel(res);
+    }
+#if PERF_COUNTERS
+    perf_open();
+#endif
+    gate_park(0);
+    while ((res = pool_take(w)) != NULL)
+    {
+#if PERF_COUNTERS
+        core_counters begin, end;
+#endif
+        ee_u32 count = pool_batch(res);
+        if (res->port.done == 0)
+            res->start_ticks = portable_ticks();
+        if (count == 0)
+        { /* context is done */
+            res->iterations = res->port.done;
+            res->stop_ticks = portable_ticks();
+            continue;
+        }
+#if PERF_COUNTERS
+        portable_counters_read(&begin);
+#endif
+        iterate_batch(res, res->port.done, count);
+#if PERF_COUNTERS
+        portable_counters_read(&end);
+        counters_add(&res->counters, &begin, &end);
+#endif
+        res->port.done += count;
+        pool_push(w, res);
+    }
+#if PERF_COUNTERS
+    perf_close();
+#endif
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+    pool_retire();
+#endif
+    return NULL;
+}
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+/* Function: pool_thread_create
+        Create the thread of a worker with a stack large enough for the data of
+   the contexts dealt to it on top of the default stack size, as a worker
+   may be dealt any number of contexts.
+
+        Returns:
+        0 on success, or the error number.
+*/
+static int
+pool_thread_create(pool_worker *w)
+{
+    pthread_attr_t attr;
+    size_t         stack;
+    int            err = pthread_attr_init(&attr);
+    if (err != 0)
+        return err;
+    err = pthread_attr_getstacksize(&attr, &stack);
+    if (err == 0)
+        err = pthread_attr_setstacksize(
+            &attr, stack + (size_t)w->count * TOTAL_DATA_SIZE);
+    if (err == 0)
+        err = pthread_create(&w->thread, &attr, pool_worker_run, (void *)w);
+    pthread_attr_destroy(&attr);
+    return err;
+}
+#endif
+static ee_u8
+pool_create(void)
+{
+    ee_u32 i;
+    pool_size = pool_num_workers ? pool_num_workers : portable_num_cpus();
+    if (pool_size > default_num_contexts)
+        pool_size = default_num_contexts;
+    pool_deque_n = default_num_contexts;
+    pool         = (pool_worker *)calloc(pool_size, sizeof(pool_worker));
+    if (pool == NULL)
+    {
+        ee_printf("ERROR allocating pool of %u workers\n", pool_size);
+        return 1;
+    }
+    for (i = 0; i < pool_size; i++)
+    {
+        pool[i].deque = (core_results **)calloc(pool_deque_n,
+                                                sizeof(core_results *));
+        if (pool[i].deque == NULL)
+        {
+            ee_printf("ERROR allocating pool of %u workers\n", pool_size);
+            return 1;
+        }
+        pthread_mutex_init(&pool[i].lock, NULL);
+    }
+    pool_dealt   = 0;
+    pool_created = 0;
+    return 0;
+}
+static void
+pool_destroy(void)
+{
+    ee_u32 i;
+    for (i = 0; i < pool_size; i++)
+    {
+        pthread_mutex_destroy(&pool[i].lock);
+        free(pool[i].deque);
+    }
+    free(pool);
+    pool = NULL;
+}
+ee_u8
+core_start_parallel(core_results *res)
+{
+    ee_u32 i;
+    if ((pool == NULL) && pool_create())
+        return 1;
+    res->port.done = 0;
+    res->port.slot = pool_dealt;
+#if PERF_COUNTERS
+    counters_reset(&res->counters);
+#endif
+    pool_push(&pool[pool_dealt % pool_size], res);
+    /* workers are started once every context has been dealt */
+    if (++pool_dealt < default_num_contexts)
+        return 0;
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+    pool_running = pool_size;
+#endif
+    for (i = 0; i < pool_size; i++)
+    {
+        int err;
+        if (gate_arm(NULL))
+            return 1;
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+        err = pool_thread_create(&pool[i]);
+#else
+        err = pthread_create(
+            &pool[i].thread, NULL, pool_worker_run, (void *)&pool[i]);
+#endif
+        if (err != 0)
+        {
+            ee_printf("ERROR creating pool worker %u: %s\n", i, strerror(err));
+            gate_unarm();
+            /* the workers created are parked, drop the contexts of the
+             * others so that nothing runs on data never initialized */
+            for (; i < pool_size; i++)
+                pool[i].count = 0;
+#if (MEM_METHOD == MEM_STACK) && CONTEXT_STACK
+            pool_running = pool_created;
+#endif
+            return 1;
+        }
+        pool_created++;
+    }
+    return 0;
+}
+ee_u8
+core_stop_parallel(core_results *res)
+{
+    void * retval;
+    ee_u8  err = 0;
+    ee_u32 i;
+    /* the first context to be stopped waits for the whole pool */
+    if (pool != NULL)
+    {
+        for (i = 0; i < pool_created; i++)
+        {
+            err |= (ee_u8)pthread_join(pool[i].thread, &retval);
+            gate_done();
+        }
+        pool_destroy();
     }
-    return 1;
+    rebase_parallel(res);
+    return err;
 }
 #else /* no standard multicore implementation */
 #error \
@@ -48,6 +48,31 @@ Original Author: Shay Gal-on
 #ifndef USE_CLOCK
 #define USE_CLOCK 0
 #endif
+/* Configuration: USE_MONOTONIC_RAW
+        Define to 1 to time with CLOCK_MONOTONIC_RAW at nanosecond resolution.
+   Unlike the default CLOCK_REALTIME in milliseconds it does not jump or slew
+   under NTP. Ticks are nanoseconds, so CORE_TICKS must be 64b (or
+   TIMER_RES_DIVIDER raised).
+*/
+#ifndef USE_MONOTONIC_RAW
+#define USE_MONOTONIC_RAW 0
+#endif
+/* Configuration: USE_TSC
+        Define to 1 to time with the x86 time stamp counter, converted to
+   nanoseconds with a rate calibrated against CLOCK_MONOTONIC_RAW at startup.
+   Falls back to CLOCK_MONOTONIC_RAW if the cpu does not report an invariant
+   TSC.
+*/
+#ifndef USE_TSC
+#define USE_TSC 0
+#endif
+/* Configuration: TSC_CALIBRATION_MS
+        Time spent calibrating the rate of the time stamp counter with
+   <USE_TSC>.
+*/
+#ifndef TSC_CALIBRATION_MS
+#define TSC_CALIBRATION_MS 50
+#endif
 /* Configuration: HAS_STDIO
         Define to 1 if the platform has stdio.h.
 */
@@ -115,6 +140,7 @@ typedef signed int     ee_s32;
 typedef double         ee_f32;
 typedef unsigned char  ee_u8;
 typedef unsigned int   ee_u32;
+typedef uint64_t       ee_u64;
 typedef uintptr_t      ee_ptr_int;
 typedef size_t         ee_size_t;
 /* align an offset to point to a 32b value */
@@ -139,7 +165,8 @@ typedef size_t         ee_size_t;
         Valid values:
         MEM_MALLOC - for platforms that implement malloc and have malloc.h.
         MEM_STATIC - to use a static memory array.
-        MEM_STACK - to allocate the data block on the stack (NYI).
+        MEM_STACK - to allocate the data block on the stack, see
+   <CONTEXT_STACK> for multiple contexts.
 */
 #ifndef MEM_METHOD
 #define MEM_METHOD MEM_MALLOC
@@ -150,17 +177,22 @@ typedef size_t         ee_size_t;
 
         Valid values:
         1 - only one context (default).
-        N>1 - will execute N copies in parallel.
+        N>1 - will execute N copies in parallel by default. The number of
+   copies can be changed at run time, see <default_num_contexts>.
 
         Note:
         If this flag is defined to more then 1, an implementation for launching
    parallel contexts must be defined.
 
-        Two sample implementations are provided. Use <USE_PTHREAD> or <USE_FORK>
-   to enable them.
+        Sample implementations are provided. Use <USE_PTHREAD>, <USE_FORK>,
+   <USE_SOCKET> or <USE_POOL> to enable them.
 
         It is valid to have a different implementation of <core_start_parallel>
    and <core_end_parallel> in <core_portme.c>, to fit a particular architecture.
+   <core_start_parallel> returns 0 once the context is started, and nonzero
+   if it could not be. <core_stop_parallel> returns 0 once the results of the
+   context are gathered, and nonzero if the context failed. Either fails the
+   run.
 */
 #ifndef MULTITHREAD
 #define MULTITHREAD 1
@@ -184,7 +216,10 @@ typedef size_t         ee_size_t;
 
 /* Configuration: USE_FORK
         Sample implementation for launching parallel contexts
-        This implementation uses fork, waitpid, shmget,shmat and shmdt.
+        This implementation uses fork and waitpid. Each child writes its
+   results to its own cache line aligned slot of one anonymous shared mapping,
+   created before the first fork, so no system wide keys are used and nothing
+   outlives the run.
 
         Valid values:
         0 - Do not use fork API.
@@ -198,9 +233,49 @@ typedef size_t         ee_size_t;
 #define USE_FORK 0
 #endif
 
+/* Configuration: CACHE_LINE_SIZE
+        Size in bytes of a cache line on the target. Data written by different
+   contexts is padded to a multiple of this, so that no two contexts share a
+   line.
+*/
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/* Configuration: HUGE_PAGE_SIZE
+        Size in bytes of a huge page, for the thp and hugetlb placements of
+   the memory blocks, see A<list> in <portable_init>.
+*/
+#ifndef HUGE_PAGE_SIZE
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+
+/* Configuration: HAS_MEMBLOCK_ALLOC
+        This port places the data of the contexts itself, with alignment,
+   huge pages, colouring and locking selected at run time.
+*/
+#define HAS_MEMBLOCK_ALLOC 1
+
+/* Configuration: PACKED_RESULTS
+        Diagnostic. By default the results of each context are aligned and
+   padded to <CACHE_LINE_SIZE>, since every context keeps writing its CRCs
+   there while timed. Define to 1 to pack them back to back instead, so that
+   neighbouring contexts share cache lines and the cost of the false sharing
+   can be measured against a default build.
+*/
+#ifndef PACKED_RESULTS
+#define PACKED_RESULTS 0
+#endif
+#if !PACKED_RESULTS && defined(__GNUC__)
+#define CONTEXT_ALIGN __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+
 /* Configuration: USE_SOCKET
         Sample implementation for launching parallel contexts
-        This implementation uses fork, socket, sendto and recvfrom
+        This implementation uses fork and one AF_UNIX datagram socket pair,
+   created before the first fork. Every child sends its results to the same
+   collector socket, and the parent gathers them with epoll in the order the
+   children finish.
 
         Valid values:
         0 - Do not use fork and sockets API.
@@ -214,6 +289,155 @@ typedef size_t         ee_size_t;
 #define USE_SOCKET 0
 #endif
 
+/* Configuration: COLLECT_TIMEOUT_SECS
+        With <USE_SOCKET>, the number of seconds the parent waits for results
+   without any arriving before it gives up, kills the children still running
+   and reports them as failed. Children that exit without sending results are
+   reported as soon as they are reaped.
+
+        Valid values:
+        0 - Wait for as long as the children are alive.
+        n - Give up after n seconds without results.
+*/
+#ifndef COLLECT_TIMEOUT_SECS
+#define COLLECT_TIMEOUT_SECS 0
+#endif
+
+/* Configuration: PREFAULT_CHILDREN
+        With <USE_FORK> or <USE_SOCKET>, have every child fault in all the
+   memory it will touch before it parks on the start barrier, so that the
+   timed region takes no page faults. The memory block of the child is mapped
+   with MAP_POPULATE, some stack is touched, and the child then tries to lock
+   all its pages, which also breaks copy on write on pages still shared with
+   the parent. Locking needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK,
+   without it the child runs unlocked.
+
+        Valid values:
+        0 - Children fault in their memory as they touch it.
+        1 - Children fault in their memory before the timed region.
+*/
+#ifndef PREFAULT_CHILDREN
+#define PREFAULT_CHILDREN 1
+#endif
+
+/* Configuration: USE_POOL
+        Sample implementation for launching parallel contexts
+        This implementation runs the contexts on a fixed pool of pthreads
+   that pull batches of iterations from per worker deques and steal contexts
+   from each other.
+
+        Valid values:
+        0 - Do not use the work stealing pool.
+        1 - Use the work stealing pool.
+
+        Note:
+        This flag only matters if MULTITHREAD has been defined to a value
+   greater then 1. The number of workers defaults to the number of online
+   cpus, and may be set at run time with W<n> in <portable_init>.
+*/
+#ifndef USE_POOL
+#define USE_POOL 0
+#endif
+
+/* Configuration: POOL_BATCH
+        Number of iterations a <USE_POOL> worker runs on a context before it
+   returns the context to its deque, where peers may steal it.
+*/
+#ifndef POOL_BATCH
+#define POOL_BATCH 10
+#endif
+
+/* Configuration: POOL_CONTEXTS_PER_WORKER
+        With <USE_POOL>, <CONTEXTS_FROM_CPUS> and no M<n> argument, the number
+   of contexts run by default for each worker. A context only runs on one
+   worker at a time, so a worker can only take over work from a peer that
+   has contexts waiting in its deque. With one context per worker, there is
+   nothing to steal.
+*/
+#ifndef POOL_CONTEXTS_PER_WORKER
+#define POOL_CONTEXTS_PER_WORKER 4
+#endif
+
+/* Configuration: CONTEXTS_FROM_CPUS
+        With multiple contexts and no M<n> argument, run one context per cpu
+   the process can use: the smallest of the cpus online, the affinity mask,
+   and the effective cpuset and cpu.max quota of its cgroup v2. The limits
+   found are printed in the report.
+
+        Valid values:
+        0 - run <MULTITHREAD> contexts by default.
+        1 - run one context per usable cpu by default.
+*/
+#ifndef CONTEXTS_FROM_CPUS
+#define CONTEXTS_FROM_CPUS 1
+#endif
+
+/* Configuration: CGROUP2_MOUNT
+        Where the cgroup v2 hierarchy is mounted, for <CONTEXTS_FROM_CPUS>.
+*/
+#ifndef CGROUP2_MOUNT
+#define CGROUP2_MOUNT "/sys/fs/cgroup"
+#endif
+
+/* Configuration: HAS_AFFINITY
+        Define to 1 if the platform can pin threads to cpus and report the
+   numa node of memory (Linux sched_setaffinity and move_pages).
+
+        Note:
+        Needed for the placement policies of parallel contexts, see P<policy>
+   in <portable_init>.
+*/
+#ifndef HAS_AFFINITY
+#if defined(__linux__)
+#define HAS_AFFINITY 1
+#else
+#define HAS_AFFINITY 0
+#endif
+#endif
+
+/* Configuration: LATENCY_HISTOGRAM
+        Time every iteration with <portable_clock_ns> and report the
+   p50/p90/p99/p99.9/max latency per iteration, for each context and over all
+   of them.
+
+        Valid values:
+        0 - only the total time is measured (default).
+        1 - every iteration is also timed and kept in a histogram of its
+   context, see <core_latency>.
+*/
+#ifndef LATENCY_HISTOGRAM
+#define LATENCY_HISTOGRAM 0
+#endif
+
+/* Configuration: KERNEL_PROFILE
+        Count the calls of every kernel (list find, reverse and mergesort,
+   calc_func hits and misses, the matrix stages and the state passes) and
+   time them with <portable_clock_ns>, see <core_profile>.
+
+        Valid values:
+        0 - kernels are not instrumented (default).
+        1 - report calls and time per kernel. Timing adds a clock read around
+   every kernel call, so the total time goes up.
+*/
+#ifndef KERNEL_PROFILE
+#define KERNEL_PROFILE 0
+#endif
+
+/* Configuration: PERF_COUNTERS
+        Read performance counters with perf_event_open (Linux) over the timed
+   region of every context: cycles, instructions, branch misses, L1D and LLC
+   read misses, task clock, context switches and page faults. The report adds
+   IPC and CoreMark/GHz, see <core_counters>.
+
+        Valid values:
+        0 - no counters (default).
+        1 - read the counters. Hardware counters that cannot be opened, as in
+   most virtual machines, are left out and only the software ones reported.
+*/
+#ifndef PERF_COUNTERS
+#define PERF_COUNTERS 0
+#endif
+
 /* Configuration: MAIN_HAS_NOARGC
         Needed if platform does not support getting arguments to main.
 
@@ -241,15 +465,165 @@ typedef size_t         ee_size_t;
         Override this global value to change number of contexts used.
 
         Note:
-        This value may not be set higher then the <MULTITHREAD> define.
-
-        To experiment, you can set the <MULTITHREAD> define to the highest value
-   expected, and use argc/argv in the <portable_init> to set this value from the
-   command line.
+        Defaults to one context per usable cpu with <CONTEXTS_FROM_CPUS>, and
+   to the <MULTITHREAD> define otherwise. Contexts are allocated at run time,
+   so any value may be selected from the command line with M<n> in
+   <portable_init>, and M0 selects one context per usable cpu.
 */
 extern ee_u32 default_num_contexts;
 
+/* Variable: default_duration
+        Number of seconds parallel contexts run for.
+
+        Valid values:
+        0 - every context runs the same number of iterations (default).
+        N - every context runs iterations until a shared deadline N seconds
+   after <start_time>, and reports how many it completed. Each context still
+   runs at least one iteration, which is where the CRCs used for validation
+   are captured.
+
+        Set from the command line with D<n> in <portable_init>.
+*/
+extern ee_u32 default_duration;
+
+/* Variable: default_num_trials
+        Number of times the timed run is repeated on the same data.
+
+        Valid values:
+        1 - a single run (default).
+        N - N runs of the same number of iterations, reported with their
+   spread and a 95% confidence interval, see <MAX_TRIALS>.
+
+        Set from the command line with T<n> in <portable_init>.
+*/
+extern ee_u32 default_num_trials;
+
+/* Variable: default_sweep
+        Numbers of contexts a scaling sweep runs the timed section with,
+   <default_num_sweep> of them in increasing order. The first is always 1 as
+   the baseline for parallel efficiency, and the last is
+   <default_num_contexts>, the run that is validated and reported as usual.
+
+        Set from the command line with S for 1, 2, 4 and so on up to
+   <default_num_contexts>, or with a list such as S1,2,3,8 in
+   <portable_init>, which also sets <default_num_contexts> to its largest
+   entry. No sweep is run by default.
+*/
+extern ee_u32 default_sweep[MAX_SWEEP_STEPS];
+extern ee_u32 default_num_sweep;
+
+/* Variable: default_size_sweep
+        Data sizes per context, in bytes, a data size sweep runs the timed
+   section with, <default_num_size_sweep> of them. Each step initializes the
+   data of every context again at its size, so that the same work moves out
+   from the L1 cache to the outer caches and DRAM. The reported run keeps the
+   size from the seeds. Needs MEM_MALLOC.
+
+        Set from the command line with Z for <SIZE_SWEEP_SIZES>, or with a
+   list such as Z2K,64K,1M in <portable_init>. No sweep is run by default.
+*/
+extern ee_u32 default_size_sweep[MAX_SWEEP_STEPS];
+extern ee_u32 default_num_size_sweep;
+
+/* Variable: default_list_footprint
+        Bytes the cells of the list of every context are scattered over, 0
+   to keep them packed in the data of the context (default). Each cell and
+   each data item gets a random slot of its own within the footprint, in an
+   order drawn from the list seed, so that following the list defeats the
+   prefetchers and <core_bench_list> measures memory latency. The list and
+   its CRCs stay the same. Needs MEM_MALLOC.
+
+        Set from the command line with L<size>, such as L256M, in
+   <portable_init>.
+*/
+extern ee_u32 default_list_footprint;
+
+/* Variable: default_list_items
+        Number of items in the list of every context, 0 to size the list
+   from the data of the context like the other algorithms (default). A list
+   of a given length is built past the data of all algorithms, which keeps
+   its size, so that lists of millions of items reach out to the last level
+   cache and DRAM while the matrix and state, which run on every compare of
+   the sort, stay small. Needs LIST_WIDE and MEM_MALLOC.
+
+        Set from the command line with N<items>, such as N64K or N1M, in
+   <portable_init>.
+*/
+extern ee_u32 default_list_items;
+
+/* Variable: default_scan
+        Whether a cpu scan runs before the reported run, to qualify every cpu
+   of a machine on its own: a short single context measurement pinned to
+   each of <default_num_scan_cpus> cpus, validated against the CRCs of the
+   reported run and compared with the median throughput of all of them.
+
+        Valid values:
+        SCAN_NONE - no scan (default).
+        SCAN_SERIAL - one cpu after the other, on an otherwise idle machine.
+        SCAN_PARALLEL - all cpus at once, <default_num_contexts> at a time,
+   so that shared caches, power and thermal limits are loaded as well.
+
+        Set from the command line with C or Cp, each optionally followed by a
+   list of cpus such as C0-3,8 and by /<percent> for
+   <default_scan_deviation>, in <portable_init>. Needs HAS_AFFINITY. The
+   cpus default to those of the affinity mask.
+*/
+extern ee_u32 default_scan;
+extern ee_u32 default_num_scan_cpus;
+
+/* Variable: default_scan_step
+        The first cpu of the scan the contexts being started are pinned to,
+   context <n> to the cpu <n> places further on. -1 outside of a scan.
+*/
+extern ee_s32 default_scan_step;
+
+/* Variable: default_scan_deviation
+        Deviation from the median throughput of the scan, in percent, beyond
+   which a cpu is an outlier, see <SCAN_DEVIATION>.
+*/
+extern ee_u32 default_scan_deviation;
+
+/* Variable: default_output_format
+        How the results are reported.
+
+        Valid values:
+        OUTPUT_TEXT - the usual report (default).
+        OUTPUT_JSON - a single JSON object, see <OUTPUT_RECORD>.
+        OUTPUT_CSV - a CSV header line and one row per context. The trials,
+   sweeps and cpu scan are only in the JSON object.
+
+        Set from the command line with Ojson, Ocsv or Otext in
+   <portable_init>.
+*/
+extern ee_u32 default_output_format;
+
+#if USE_TSC
+#if !(defined(__x86_64__) || defined(__i386__))
+#error "USE_TSC needs an x86 time stamp counter"
+#endif
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
+#if PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
 #if (MULTITHREAD > 1)
+#include <unistd.h> /* for sysconf and the start barrier pipes */
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#if HAS_AFFINITY
+#include <sched.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
 #if USE_PTHREAD
 #include <pthread.h>
 #define PARALLEL_METHOD "PThreads"
@@ -257,21 +631,24 @@ extern ee_u32 default_num_contexts;
 #include <unistd.h>
 #include <errno.h>
 #include <sys/wait.h>
-#include <sys/shm.h>
 #include <string.h> /* for memcpy */
 #define PARALLEL_METHOD "Fork"
 #elif USE_SOCKET
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <sys/epoll.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #define PARALLEL_METHOD "Sockets"
+#elif USE_POOL
+#include <pthread.h>
+#include <stdlib.h>
+#define PARALLEL_METHOD "WorkStealing"
 #else
 #define PARALLEL_METHOD "Proprietary"
 #error \
@@ -286,13 +663,12 @@ typedef struct CORE_PORTABLE_S
     pthread_t thread;
 #elif USE_FORK
     pid_t pid;
-    int   shmid;
-    void *shm;
 #elif USE_SOCKET
-    pid_t              pid;
-    int                sock;
-    struct sockaddr_in sa;
+    pid_t pid;
+#elif USE_POOL
+    ee_u32 done; /* iterations run so far */
 #endif /* Method for multithreading */
+    ee_u32 slot; /* order in which the context was started */
 #endif /* MULTITHREAD>1 */
     ee_u8 portable_id;
 } core_portable;
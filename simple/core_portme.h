@@ -97,6 +97,7 @@ typedef signed int     ee_s32;
 typedef double         ee_f32;
 typedef unsigned char  ee_u8;
 typedef unsigned int   ee_u32;
+typedef unsigned long long ee_u64;
 typedef ee_u32         ee_ptr_int;
 typedef size_t         ee_size_t;
 /* align_mem :
@@ -185,6 +186,16 @@ typedef size_t         ee_size_t;
 */
 extern ee_u32 default_num_contexts;
 
+/* Variable : default_num_trials
+        Not used for this simple port, must contain the value 1.
+*/
+extern ee_u32 default_num_trials;
+
+/* Variable : default_output_format
+        Not used for this simple port, must contain the value 0.
+*/
+extern ee_u32 default_output_format;
+
 typedef struct CORE_PORTABLE_S
 {
     ee_u8 portable_id;